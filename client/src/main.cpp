@@ -2,13 +2,17 @@
 #include <yojimbo.h>
 #include <cstring>
 #include <entt/entt.hpp>
+#include <memory>
+#include <optional>
 
 #include <actorspawner.h>
 #include <components.h>
 #include <game.h>
+#include <generation/generationtask.h>
 #include <generation/wfc/wfcstrategy.h>
 #include <generation/wfc/wfctileset.h>
 #include <grid.h>
+#include <gridfile.h>
 #include <inputhandler.h>
 #include <rendercomponents.h>
 #include <renderlayers/entities/entityrendersystem.h>
@@ -31,7 +35,7 @@ struct CameraInputState {
 static CameraInputState cameraInput;
 constexpr float CAMERA_SPEED = 2000.0f;
 
-int main() {
+int main(int argc, char* argv[]) {
 #if !defined(NDEBUG)
     spdlog::set_level(spdlog::level::trace);
     // yojimbo_log_level(YOJIMBO_LOG_LEVEL_DEBUG);
@@ -96,12 +100,39 @@ int main() {
 
         tileRenderer->loadTileVariantsIntoAtlas(tileSet.getTileVariants());
 
-        SpaceRogueLite::WFCStrategy wfcStrategy({2, glm::ivec2(2, 2), glm::ivec2(6, 6), 0},
-                                                tileSet);
-        auto generatedMap = wfcStrategy.generate();
-
         auto& grid = entt::locator<SpaceRogueLite::Grid>::value();
-        grid.setTiles(generatedMap, wfcStrategy.getWidth(), wfcStrategy.getHeight());
+
+        // A saved map can be given on the command line, otherwise one is generated in the
+        // background and streamed into the grid while the game runs
+        bool isMapLoaded = false;
+        std::optional<SpaceRogueLite::GenerationTask> generationTask;
+
+        // Scoped to the load so the file's mapping goes once the grid has the pages
+        if (argc > 1) {
+            SpaceRogueLite::GridFile mapFile;
+
+            if (mapFile.open(argv[1], tileSet.getVariantTable()) && mapFile.loadInto(grid)) {
+                isMapLoaded = true;
+                spdlog::info("Loaded {}x{} map from {}", grid.getWidth(), grid.getHeight(),
+                             argv[1]);
+            }
+        }
+
+        if (!isMapLoaded) {
+            generationTask.emplace(std::make_unique<SpaceRogueLite::WFCStrategy>(
+                SpaceRogueLite::WFCStrategy::RoomConfiguration{2, glm::ivec2(2, 2),
+                                                               glm::ivec2(6, 6), 0},
+                tileSet));
+        }
+
+        // A map from the server replaces the generated one, so generation stops publishing when it
+        // arrives. Declared after the task so it disconnects before the task is destroyed
+        entt::scoped_connection serverMapConnection;
+        if (generationTask.has_value()) {
+            serverMapConnection = dispatcher.sink<SpaceRogueLite::ServerMapEvent>()
+                                      .connect<&SpaceRogueLite::GenerationTask::cancel>(
+                                          *generationTask);
+        }
 
         window.createRenderLayer<SpaceRogueLite::EntityRenderSystem>(registry);
 
@@ -116,6 +147,14 @@ int main() {
                  client.update(timeSinceLastFrame);
              }});
 
+        // Runs before the render loop so finished parts of the map are drawn the same frame
+        if (generationTask.has_value()) {
+            game.attachWorker({0, "MapGeneration",
+                               [&generationTask, &grid](int64_t timeSinceLastFrame, bool& quit) {
+                                   generationTask->publishTo(grid);
+                               }});
+        }
+
         game.attachWorker({2, "RenderLoop", [&window](int64_t timeSinceLastFrame, bool& quit) {
                                window.update(timeSinceLastFrame, quit);
                            }});
@@ -4,12 +4,17 @@
 #include <entt/entt.hpp>
 
 #include "actorspawner.h"
+#include "grid.h"
+#include "griddelta.h"
 #include "handlerregistry.h"
 #include "messagefactory.h"
 #include "messagehandler.h"
 
 namespace SpaceRogueLite {
 
+// The server has started sending its map, anything generated locally should give way to it
+struct ServerMapEvent {};
+
 /**
  * @brief Client-side implementation of MessageHandler
  *
@@ -70,6 +75,22 @@ inline void ClientMessageHandler::handleMessage<SpawnActorMessage>(SpawnActorMes
     dispatcher.trigger<ActorSpawnEvent>({std::string(message->actorName)});
 }
 
+template <>
+inline void ClientMessageHandler::handleMessage<GridDeltaMessage>(GridDeltaMessage* message) {
+    auto& grid = entt::locator<Grid>::value();
+
+    const std::span<const uint8_t> delta(message->delta, message->deltaSize);
+
+    if (!GridDelta::apply(grid, delta)) {
+        spdlog::error("Failed to apply grid delta from server, the map is now out of sync");
+        return;
+    }
+
+    if (GridDelta::isReset(delta)) {
+        dispatcher.trigger<ServerMapEvent>({});
+    }
+}
+
 /**
  * Creates a type-safe handler function for a specific message type
  *
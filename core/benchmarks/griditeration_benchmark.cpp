@@ -0,0 +1,148 @@
+#include <grid.h>
+#include <spdlog/spdlog.h>
+
+#include <functional>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "utils/timing.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr int GRID_SIZE = 1024;
+constexpr int NUM_PASSES = 20;
+constexpr GridRegion REGION = {300, 200, 256, 256};
+
+// Work done per tile, cheap enough that the cost of reaching the tile dominates. Passes sum into a
+// local so the compiler can keep the totals in registers
+struct Checksum {
+    uint64_t ids = 0;
+    uint64_t walkable = 0;
+
+    void add(const GridTile& tile) {
+        ids += tile.id;
+        walkable += tile.walkable == GridTile::WALKABLE;
+    }
+
+    void add(const Checksum& other) {
+        ids += other.ids;
+        walkable += other.walkable;
+    }
+
+    bool operator==(const Checksum& other) const {
+        return ids == other.ids && walkable == other.walkable;
+    }
+};
+
+template <typename Pass>
+Checksum run(const std::string& name, size_t tilesPerPass, Pass&& pass) {
+    Checksum checksum;
+
+    auto startTime = Utils::getMicroseconds();
+    for (int i = 0; i < NUM_PASSES; i++) {
+        checksum.add(pass());
+    }
+    auto time = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    spdlog::info("  {}: {}ms ({:.0f} Mtiles/s)", name, time,
+                 tilesPerPass * NUM_PASSES / (time * 1000.0));
+
+    return checksum;
+}
+
+}  // namespace
+
+int main() {
+    Grid grid(GRID_SIZE, GRID_SIZE);
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> tileId(0, 7);
+
+    std::vector<GridTile> tiles(GRID_SIZE * GRID_SIZE);
+    for (auto& tile : tiles) {
+        TileId id = tileId(rng);
+        tile = {id, TILE_VARIANT_NONE, id > 2 ? GridTile::WALKABLE : GridTile::BLOCKED, 0};
+    }
+    grid.setTiles(tiles, GRID_SIZE, GRID_SIZE);
+
+    const size_t gridTiles = size_t(GRID_SIZE) * GRID_SIZE;
+    const size_t regionTiles = size_t(REGION.width) * REGION.height;
+
+    spdlog::info("{} passes over a {}x{} grid", NUM_PASSES, GRID_SIZE, GRID_SIZE);
+
+    // What forEachTile cost before it was templated, one indirect call per tile
+    auto functionTiles = run("forEachTile (std::function)", gridTiles, [&]() {
+        Checksum checksum;
+        std::function<void(int, int, const GridTile&)> callback =
+            [&](int x, int y, const GridTile& tile) { checksum.add(tile); };
+        grid.forEachTile(callback);
+        return checksum;
+    });
+
+    auto getTileTiles = run("getTile per tile", gridTiles, [&]() {
+        Checksum checksum;
+        for (int y = 0; y < GRID_SIZE; y++) {
+            for (int x = 0; x < GRID_SIZE; x++) {
+                checksum.add(grid.getTile(x, y));
+            }
+        }
+        return checksum;
+    });
+
+    auto visitorTiles = run("forEachTile (visitor)", gridTiles, [&]() {
+        Checksum checksum;
+        grid.forEachTile([&](int x, int y, const GridTile& tile) { checksum.add(tile); });
+        return checksum;
+    });
+
+    auto spanTiles = run("forEachRowSpan", gridTiles, [&]() {
+        Checksum checksum;
+        grid.forEachRowSpan(grid.getBounds(),
+                            [&](int x, int y, std::span<const GridTile> row) {
+                                for (const auto& tile : row) {
+                                    checksum.add(tile);
+                                }
+                            });
+        return checksum;
+    });
+
+    spdlog::info("{}x{} region at ({}, {})", REGION.width, REGION.height, REGION.x, REGION.y);
+
+    auto getTileRegion = run("getTile per tile", regionTiles, [&]() {
+        Checksum checksum;
+        for (int y = REGION.y; y < REGION.y + REGION.height; y++) {
+            for (int x = REGION.x; x < REGION.x + REGION.width; x++) {
+                checksum.add(grid.getTile(x, y));
+            }
+        }
+        return checksum;
+    });
+
+    auto visitorRegion = run("forEachTile (visitor)", regionTiles, [&]() {
+        Checksum checksum;
+        grid.forEachTile(REGION, [&](int x, int y, const GridTile& tile) { checksum.add(tile); });
+        return checksum;
+    });
+
+    auto spanRegion = run("forEachRowSpan", regionTiles, [&]() {
+        Checksum checksum;
+        grid.forEachRowSpan(REGION, [&](int x, int y, std::span<const GridTile> row) {
+            for (const auto& tile : row) {
+                checksum.add(tile);
+            }
+        });
+        return checksum;
+    });
+
+    bool isConsistent = functionTiles == getTileTiles && functionTiles == visitorTiles &&
+                        functionTiles == spanTiles && getTileRegion == visitorRegion &&
+                        getTileRegion == spanRegion;
+
+    spdlog::info("Checksums {}", isConsistent ? "match" : "DIFFER");
+
+    return isConsistent ? 0 : 1;
+}
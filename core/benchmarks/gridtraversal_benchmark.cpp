@@ -0,0 +1,147 @@
+#include <grid.h>
+#include <gridtraversal.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "utils/timing.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr int GRID_SIZE = 512;
+constexpr int NUM_SEGMENTS = 2000;
+
+// The bounding box scan Grid::getIntersections used before traverseGrid, kept as a baseline
+namespace Legacy {
+
+float pointOnLineSide(const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& point) {
+    return ((p2.y - p1.y) * point.x) + ((p1.x - p2.x) * point.y) + (p2.x * p1.y - p1.x * p2.y);
+}
+
+bool hasPointsOnDifferentSides(const glm::vec2& p1, const glm::vec2& p2,
+                               const std::vector<glm::vec2>& corners) {
+    float p = pointOnLineSide(p1, p2, corners[0]);
+
+    for (int i = 1; i < 4; i++) {
+        p *= pointOnLineSide(p1, p2, corners[i]);
+        if (p < 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool hasTileIntersection(const glm::vec2& p1, const glm::vec2& p2, int x, int y) {
+    std::vector<glm::vec2> corners = {glm::vec2(x, y), glm::vec2(x, y + 1), glm::vec2(x + 1, y),
+                                      glm::vec2(x + 1, y + 1)};
+
+    if (!hasPointsOnDifferentSides(p1, p2, corners)) {
+        return false;
+    } else if (p1.x > corners[3].x && p2.x > corners[3].x) {
+        return false;
+    } else if (p1.x < corners[0].x && p2.x < corners[0].x) {
+        return false;
+    } else if (p1.y > corners[3].y && p2.y > corners[3].y) {
+        return false;
+    } else if (p1.y < corners[0].y && p2.y < corners[0].y) {
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<glm::ivec2> getIntersections(const Grid& grid, const glm::vec2& p1,
+                                         const glm::vec2& p2) {
+    std::vector<glm::ivec2> intersections;
+
+    auto op1 = p1 + glm::vec2(.5f, .5f);
+    auto op2 = p2 + glm::vec2(.5f, .5f);
+
+    int xMin = std::max(0, (int) std::floor(std::min(op1.x, op2.x)));
+    int xMax = std::min(grid.getWidth(), (int) std::ceil(std::max(op1.x, op2.x)));
+    int yMin = std::max(0, (int) std::floor(std::min(op1.y, op2.y)));
+    int yMax = std::min(grid.getHeight(), (int) std::ceil(std::max(op1.y, op2.y)));
+
+    for (int x = xMin; x < xMax; x++) {
+        for (int y = yMin; y < yMax; y++) {
+            if (hasTileIntersection(op1, op2, x, y)) {
+                intersections.push_back(glm::ivec2(x, y));
+            }
+        }
+    }
+
+    return intersections;
+}
+
+}  // namespace Legacy
+
+bool sameCells(std::vector<glm::ivec2> a, std::vector<glm::ivec2> b) {
+    auto byPosition = [](const glm::ivec2& lhs, const glm::ivec2& rhs) {
+        return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+    };
+
+    std::sort(a.begin(), a.end(), byPosition);
+    std::sort(b.begin(), b.end(), byPosition);
+
+    return a == b;
+}
+
+}  // namespace
+
+int main() {
+    Grid grid(GRID_SIZE, GRID_SIZE);
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> position(1, GRID_SIZE - 2);
+
+    // Room centre to room centre segments, as used for corridors in WFCStrategy
+    std::vector<std::pair<glm::vec2, glm::vec2>> segments;
+    for (int i = 0; i < NUM_SEGMENTS; i++) {
+        segments.push_back({glm::vec2(position(rng), position(rng)),
+                            glm::vec2(position(rng), position(rng))});
+    }
+
+    size_t legacyCells = 0;
+    auto startTime = Utils::getMicroseconds();
+    for (const auto& [p1, p2] : segments) {
+        legacyCells += Legacy::getIntersections(grid, p1, p2).size();
+    }
+    auto legacyTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    size_t intersectionCells = 0;
+    startTime = Utils::getMicroseconds();
+    for (const auto& [p1, p2] : segments) {
+        intersectionCells += grid.getIntersections(p1, p2).size();
+    }
+    auto intersectionTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    size_t traversalCells = 0;
+    startTime = Utils::getMicroseconds();
+    for (const auto& [p1, p2] : segments) {
+        traverseGrid(p1, p2, TraversalMode::THIN, [&](int x, int y) { traversalCells++; });
+    }
+    auto traversalTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    int mismatches = 0;
+    for (const auto& [p1, p2] : segments) {
+        if (!sameCells(Legacy::getIntersections(grid, p1, p2), grid.getIntersections(p1, p2))) {
+            mismatches++;
+        }
+    }
+
+    spdlog::info("{} segments on a {}x{} grid", NUM_SEGMENTS, GRID_SIZE, GRID_SIZE);
+    spdlog::info("  legacy bounding box scan: {}ms ({} cells)", legacyTime, legacyCells);
+    spdlog::info("  Grid::getIntersections:   {}ms ({} cells)", intersectionTime,
+                 intersectionCells);
+    spdlog::info("  traverseGrid (visitor):   {}ms ({} cells)", traversalTime, traversalCells);
+    // The legacy side test accumulates a product of corner signs, so it also reports cells with
+    // three corners on the same side of the line. Differences here are expected
+    spdlog::info("  {} segments differ from the legacy scan", mismatches);
+
+    return 0;
+}
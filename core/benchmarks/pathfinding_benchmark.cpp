@@ -0,0 +1,170 @@
+#include <generation/wfc/wfcstrategy.h>
+#include <generation/wfc/wfctileset.h>
+#include <grid.h>
+#include <pathfinding/hierarchicalpathfinder.h>
+#include <pathfinding/pathfinder.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <entt/entt.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/threadpool.h"
+#include "utils/timing.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr int NUM_QUERIES = 4000;
+
+struct MapConfiguration {
+    int size;
+    GenerationStrategy::RoomConfiguration rooms;
+};
+
+std::vector<PathQuery> createQueries(const Pathfinder& pathfinder, std::mt19937& rng) {
+    const auto& walkability = pathfinder.getWalkability();
+    std::uniform_int_distribution<int> x(0, walkability.getWidth() - 1);
+    std::uniform_int_distribution<int> y(0, walkability.getHeight() - 1);
+
+    auto randomWalkable = [&]() {
+        glm::ivec2 position;
+        do {
+            position = glm::ivec2(x(rng), y(rng));
+        } while (!walkability.isWalkable(position.x, position.y));
+        return position;
+    };
+
+    std::vector<PathQuery> queries;
+    for (int i = 0; i < NUM_QUERIES; i++) {
+        queries.push_back({randomWalkable(), randomWalkable()});
+    }
+
+    return queries;
+}
+
+void runQueries(Pathfinder& pathfinder, const std::vector<PathQuery>& queries,
+                Pathfinder::Mode mode, const std::string& name,
+                std::vector<PathResult>& results) {
+    // Single threaded, reusing one result so the timings show the per query cost
+    PathResult result;
+    uint64_t expandedNodes = 0;
+    size_t found = 0;
+
+    auto startTime = Utils::getMicroseconds();
+    for (const auto& query : queries) {
+        found += pathfinder.findPath(query.start, query.goal, mode, result);
+        expandedNodes += result.expandedNodes;
+    }
+    auto singleTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    startTime = Utils::getMicroseconds();
+    pathfinder.findPaths(queries, mode, results);
+    auto batchTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+    spdlog::info("  {}: {}ms single ({:.0f} queries/s), {}ms batched ({:.0f} queries/s)", name,
+                 singleTime, queries.size() / (singleTime / 1000.0), batchTime,
+                 queries.size() / (batchTime / 1000.0));
+    spdlog::info("  {}: {} of {} found, {} nodes expanded per query", name, found,
+                 queries.size(), expandedNodes / std::max<size_t>(queries.size(), 1));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string rulesPath =
+        argc > 1 ? argv[1] : "../../../assets/tilesets/grass_and_rocks/rules.json";
+
+    WFCTileSet tileSet(rulesPath);
+    tileSet.load();
+
+    std::vector<MapConfiguration> maps = {
+        {128, {8, glm::ivec2(4, 4), glm::ivec2(12, 12), 0}},
+        {256, {24, glm::ivec2(4, 4), glm::ivec2(16, 16), 0}},
+        {512, {64, glm::ivec2(4, 4), glm::ivec2(24, 24), 0}},
+    };
+
+    std::mt19937 rng(1234);
+
+    for (const auto& map : maps) {
+        entt::locator<Grid>::reset();
+        auto& grid = entt::locator<Grid>::emplace(map.size, map.size);
+
+        WFCStrategy strategy(map.rooms, tileSet);
+        auto startTime = Utils::getMicroseconds();
+        auto generatedMap = strategy.generate();
+        auto generationTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+        if (generatedMap.empty()) {
+            spdlog::warn("{}x{} WFC map failed to generate, skipping", map.size, map.size);
+            continue;
+        }
+
+        grid.setTiles(std::move(generatedMap), strategy.getWidth(), strategy.getHeight());
+
+        Pathfinder pathfinder(grid);
+        pathfinder.update();
+
+        bool hasWalkableTile = false;
+        grid.forEachTile([&](int x, int y, const GridTile& tile) {
+            hasWalkableTile |= tile.walkable == GridTile::WALKABLE;
+        });
+
+        if (!hasWalkableTile) {
+            spdlog::warn("{}x{} WFC map has no walkable tiles, skipping", map.size, map.size);
+            continue;
+        }
+
+        spdlog::info("{}x{} WFC map ({}ms to generate), {} queries on {} threads", map.size,
+                     map.size, generationTime, NUM_QUERIES,
+                     Utils::getThreadPool().getThreadCount());
+
+        auto queries = createQueries(pathfinder, rng);
+
+        std::vector<PathResult> aStarResults;
+        std::vector<PathResult> jumpPointResults;
+        runQueries(pathfinder, queries, Pathfinder::ASTAR, "A*  ", aStarResults);
+        runQueries(pathfinder, queries, Pathfinder::JUMP_POINT, "JPS ", jumpPointResults);
+
+        // Both searches are optimal, so only the route (not the cost) may differ between them
+        int mismatches = 0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (aStarResults[i].found != jumpPointResults[i].found ||
+                std::abs(aStarResults[i].cost - jumpPointResults[i].cost) > 0.01f) {
+                mismatches++;
+            }
+        }
+        spdlog::info("  {} queries differ in cost between A* and JPS", mismatches);
+
+        startTime = Utils::getMicroseconds();
+        HierarchicalPathfinder hierarchicalPathfinder(grid);
+        hierarchicalPathfinder.update();
+        auto buildTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+        PathResult result;
+        double costRatio = 0.0;
+        size_t found = 0;
+
+        startTime = Utils::getMicroseconds();
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (hierarchicalPathfinder.findPath(queries[i].start, queries[i].goal, result) &&
+                aStarResults[i].cost > 0.0f) {
+                costRatio += result.cost / aStarResults[i].cost;
+                found++;
+            }
+        }
+        auto queryTime = (Utils::getMicroseconds() - startTime) / 1000.0;
+
+        spdlog::info("  HPA*: {}ms single ({:.0f} queries/s), {}ms to build {} entrances",
+                     queryTime, queries.size() / (queryTime / 1000.0), buildTime,
+                     hierarchicalPathfinder.getEntranceCount());
+        spdlog::info("  HPA*: paths cost {:.3f}x the optimal on average",
+                     costRatio / std::max<size_t>(found, 1));
+    }
+
+    return 0;
+}
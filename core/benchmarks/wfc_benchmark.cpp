@@ -0,0 +1,74 @@
+#include <generation/wfc/compiledtileset.h>
+#include <generation/wfc/wavestate.h>
+#include <generation/wfc/wfctileset.h>
+#include <spdlog/spdlog.h>
+
+#include <fastwfc/wfc.hpp>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "utils/timing.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr int NUM_SEEDS = 3;
+constexpr int BACKTRACK_LIMIT = 32;
+
+// fast-wfc scans every cell for the lowest entropy on each observation, above this it takes far
+// too long to be worth waiting for
+constexpr int DEFAULT_MAX_FAST_WFC_SIZE = 512;
+
+void runSolver(const std::string& name, int size,
+               const std::function<std::optional<Array2D<unsigned>>(int)>& solve) {
+    int solved = 0;
+
+    auto startTime = Utils::getMicroseconds();
+    for (int seed = 0; seed < NUM_SEEDS; seed++) {
+        solved += solve(seed).has_value();
+    }
+    auto timeTaken = (Utils::getMicroseconds() - startTime) / 1000.0 / NUM_SEEDS;
+
+    spdlog::info("  {}: {}ms per solve ({:.0f} cells/ms), {} of {} solved", name, timeTaken,
+                 size * size / timeTaken, solved, NUM_SEEDS);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string rulesPath =
+        argc > 1 ? argv[1] : "../../../assets/tilesets/grass_and_rocks/rules.json";
+    int maxFastWfcSize = argc > 2 ? std::stoi(argv[2]) : DEFAULT_MAX_FAST_WFC_SIZE;
+
+    WFCTileSet tileSet(rulesPath);
+    tileSet.load();
+
+    const auto& rules = tileSet.getCompiledTileSet();
+
+    for (int size : {128, 512, 1024}) {
+        spdlog::info("{}x{} map, {} patterns, {} seeds", size, size, rules.getPatternCount(),
+                     NUM_SEEDS);
+
+        if (size <= maxFastWfcSize) {
+            runSolver("fast-wfc           ", size, [&](int seed) {
+                WFC wfc(false, seed, rules.getWeights(), rules.getPropagator(), size, size);
+                return wfc.run();
+            });
+        } else {
+            spdlog::info("  fast-wfc           : skipped, pass a larger max size to run it");
+        }
+
+        runSolver("WaveState          ", size, [&](int seed) {
+            return WaveState(rules, size, size).solve(seed);
+        });
+
+        runSolver("WaveState backtrack", size, [&](int seed) {
+            return WaveState(rules, size, size).solve(seed, BACKTRACK_LIMIT);
+        });
+    }
+
+    return 0;
+}
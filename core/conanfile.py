@@ -19,7 +19,7 @@ class coreRecipe(ConanFile):
     default_options = {"shared": False, "fPIC": True}
 
     # Sources are located in the same place as this recipe, copy them to the recipe
-    exports_sources = "CMakeLists.txt", "src/*", "include/*"
+    exports_sources = "CMakeLists.txt", "src/*", "include/*", "benchmarks/*"
 
     def requirements(self):
         self.requires("entt/3.15.0", transitive_headers=True)
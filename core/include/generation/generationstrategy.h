@@ -1,7 +1,9 @@
 #pragma once
 
 #include <entt/entt.hpp>
+#include <functional>
 #include <glm/glm.hpp>
+#include <stop_token>
 #include <vector>
 #include "grid.h"
 
@@ -21,12 +23,26 @@ public:
         glm::ivec2 max;
     } Room;
 
+    // region is the part of the map just finished, tiles the whole row-major map being generated.
+    // Strategies may call it from several threads at once, and tiles outside of region may still
+    // be being written, so copy out the region and nothing else
+    using ProgressCallback =
+        std::function<void(const GridRegion& region, const std::vector<GridTile>& tiles)>;
+
     GenerationStrategy(const RoomConfiguration& roomConfiguration);
+    virtual ~GenerationStrategy() = default;
 
+    // The row-major map, or empty if no map could be generated (or it was stopped)
     virtual std::vector<GridTile> generate(void) = 0;
 
-    void setTile(int x, int y, const GridTile& tile);
-    GridTile getTile(int x, int y) const;
+    // Lets parts of the map be shown before generate returns. Anything reported can still be
+    // replaced (a later attempt, say), only the map generate returns is final
+    void setProgressCallback(ProgressCallback callback);
+
+    // Asks a running generate to give up as soon as it can, safe to call from any thread. What
+    // generate returns after a stop isn't a finished map
+    void requestStop(void);
+    bool isStopRequested(void) const;
 
     int getWidth(void) const;
     int getHeight(void) const;
@@ -35,20 +51,23 @@ public:
     void addRoom(const Room& room);
     const std::vector<Room>& getRooms(void) const;
     void clearRooms(void);
-    bool hasCollision(const Room& room, const std::vector<Room>& existingRooms);
-    bool hasCollision(const Room& roomA, const Room& roomB);
-    bool isSparse(const Room& room, const std::vector<Room>& existingRooms);
-    int shortestDistance(const Room& room, const std::vector<Room>& existingRooms);
-    int distance(const Room& roomA, const Room& roomB);
+    bool hasCollision(const Room& room, const std::vector<Room>& existingRooms) const;
+    bool hasCollision(const Room& roomA, const Room& roomB) const;
+    bool isSparse(const Room& room, const std::vector<Room>& existingRooms) const;
+    int shortestDistance(const Room& room, const std::vector<Room>& existingRooms) const;
+    int distance(const Room& roomA, const Room& roomB) const;
 
-    const std::vector<GridTile>& getData(void) const;
+protected:
+    void reportProgress(const GridRegion& region, const std::vector<GridTile>& tiles) const;
+    std::stop_token getStopToken(void) const;
 
 private:
-    std::vector<GridTile> data;  // Row-major: data[y * width + x]
     int width;
     int height;
     RoomConfiguration roomConfiguration;
     std::vector<Room> rooms;
+    ProgressCallback progressCallback;
+    std::stop_source stopSource;
 };
 
 }  // namespace SpaceRogueLite
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "generation/generationstrategy.h"
+#include "grid.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Runs a GenerationStrategy on the shared thread pool and streams the map into a Grid.
+ *
+ * Parts of the map the strategy reports as finished are queued up, and publishTo writes them into
+ * the grid from the thread that owns it, so the grid is never touched from the pool. Only chunks
+ * whose tiles change are marked dirty, letting the renderer bake the map as it arrives rather than
+ * all at once at the end. The map generate returns is published last and is the final one.
+ *
+ * Only the regions the strategy generated are ever written, and the grid is never resized, so a
+ * task which is cancelled (because a server sent its own map, say) leaves the grid alone from then
+ * on.
+ */
+class GenerationTask {
+public:
+    // Generation starts straight away
+    explicit GenerationTask(std::unique_ptr<GenerationStrategy> strategy);
+
+    // Cancels generation and waits for the strategy to stop
+    ~GenerationTask();
+
+    GenerationTask(const GenerationTask&) = delete;
+    GenerationTask& operator=(const GenerationTask&) = delete;
+
+    // Writes everything finished since the last call into grid. Call from the thread that writes
+    // to grid. True once there is nothing left to publish, the whole map or nothing if cancelled.
+    // A grid that is no longer the size of the map cancels the task rather than being resized
+    bool publishTo(Grid& grid);
+
+    // Nothing more is published, anything queued is dropped and the strategy is asked to stop
+    void cancel(void);
+    bool isCancelled(void) const;
+
+    // The strategy has finished, though its map may not have been published yet
+    bool isFinished(void) const;
+    bool isPublished(void) const;
+
+    // Blocks until generation finishes, the map is still published by publishTo
+    void wait(void);
+
+    // Rooms and anything else the strategy kept are safe to read once it has finished
+    const GenerationStrategy& getStrategy(void) const;
+
+private:
+    struct FinishedRegion {
+        GridRegion region;
+        std::vector<GridTile> tiles;  // Row-major within the region
+    };
+
+    std::unique_ptr<GenerationStrategy> strategy;
+    std::future<std::vector<GridTile>> result;
+    bool published = false;
+    std::atomic<bool> cancelled = false;
+
+    std::mutex mutex;
+    std::vector<FinishedRegion> finishedRegions;  // Guarded by mutex
+
+    void onProgress(const GridRegion& region, const std::vector<GridTile>& tiles);
+};
+
+}  // namespace SpaceRogueLite
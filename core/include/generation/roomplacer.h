@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+#include "generation/generationstrategy.h"
+#include "utils/randomutils.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Places non-colliding, sparse rooms for a GenerationStrategy within a fixed budget.
+ *
+ * Each room first tries a few uniformly random positions. Once those start failing, candidates
+ * are Poisson-disk sampled in a ring around rooms already placed, which keeps finding space as
+ * the map fills. If neither finds a spot a minimum size room is tried the same way, and if that
+ * fails too the map is considered full. Placed rooms are kept in a bucket grid so each candidate
+ * is only checked against the rooms near it.
+ */
+class RoomPlacer {
+public:
+    explicit RoomPlacer(const GenerationStrategy& strategy);
+
+    // Empty if there's no room left, every later call will be too
+    std::optional<GenerationStrategy::Room> place(Utils::RandomGenerator& rng);
+
+    const std::vector<GenerationStrategy::Room>& getRooms(void) const;
+
+private:
+    using Room = GenerationStrategy::Room;
+
+    static constexpr int UNIFORM_ATTEMPTS = 16;
+    static constexpr int POISSON_CANDIDATES = 30;
+    static constexpr int MAX_POISSON_ATTEMPTS = 256;
+
+    const GenerationStrategy& strategy;
+    bool isFull = false;
+
+    std::vector<Room> rooms;
+    std::vector<size_t> activeRooms;  // Rooms which may still have space around them
+
+    int spacing;     // Poisson-disk radius between room centres
+    int bucketSize;  // Larger than any room, so a room touches at most 2x2 buckets
+    glm::ivec2 bucketCount;
+    std::vector<std::vector<size_t>> buckets;
+
+    std::optional<Room> placeSized(Utils::RandomGenerator& rng, const glm::ivec2& minSize,
+                                   const glm::ivec2& maxSize, bool canRetire);
+    std::optional<Room> createUniformRoom(Utils::RandomGenerator& rng,
+                                          const glm::ivec2& size) const;
+    std::optional<Room> createRoomAround(Utils::RandomGenerator& rng, const Room& room,
+                                         const glm::ivec2& size) const;
+    glm::ivec2 createRoomSize(Utils::RandomGenerator& rng, const glm::ivec2& minSize,
+                              const glm::ivec2& maxSize) const;
+
+    bool isInBounds(const Room& room) const;
+    bool canPlace(const Room& room) const;
+    void add(const Room& room);
+};
+
+}  // namespace SpaceRogueLite
@@ -13,8 +13,9 @@ public:
     virtual ~TileSet() = default;
 
     virtual const std::set<TileVariant>& getTileVariants() const = 0;
+    virtual const TileVariantTable& getVariantTable() const = 0;
     virtual const std::unordered_map<TileId, bool>& getWalkableTiles() const = 0;
-    virtual GridTile::Walkability getTileWalkability(TileId id) = 0;
+    virtual GridTile::Walkability getTileWalkability(TileId id) const = 0;
 
     virtual unsigned getEdgeTileIndex() const = 0;
     virtual unsigned getRoomTileIndex() const = 0;
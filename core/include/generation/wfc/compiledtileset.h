@@ -0,0 +1,51 @@
+#pragma once
+
+#include <fastwfc/tiling_wfc.hpp>
+#include <fastwfc/utils/array2D.hpp>
+#include <fastwfc/wfc.hpp>
+#include <optional>
+#include <tuple>
+#include <vector>
+#include "wfctileset.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief WFC rules expanded once into the form the solver runs on.
+ *
+ * Every orientation of every tile is given a pattern, with its share of the tile's weight, and the
+ * neighbour rules are expanded through each tile's symmetries into the allowed patterns per
+ * direction. This is the work TilingWFC repeats on every construction; a CompiledTileSet does it
+ * once and is then shared read-only, so any number of threads can solve with it (see WaveState).
+ */
+class CompiledTileSet {
+public:
+    using Neighbour = std::tuple<unsigned, unsigned, unsigned, unsigned>;
+
+    CompiledTileSet(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                    const std::vector<Neighbour>& neighbours);
+
+    // From weights and a propagator read back from a cache, which must match the tiles
+    CompiledTileSet(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                    std::vector<double> weights, Propagator::PropagatorState propagator);
+
+    std::optional<unsigned> getPattern(unsigned tile, unsigned orientation) const;
+
+    const WFCTileSet::WFCTile& getPatternTile(unsigned pattern) const;
+
+    size_t getPatternCount(void) const;
+    const std::vector<double>& getWeights(void) const;
+    const Propagator::PropagatorState& getPropagator(void) const;
+
+private:
+    std::vector<WFCTileSet::WFCTile> patternTiles;  // Indexed by pattern
+    std::vector<std::vector<unsigned>> patternIds;  // [tile][orientation] -> pattern
+    std::vector<double> weights;
+    Propagator::PropagatorState propagator;
+
+    void buildPatterns(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles);
+    void buildPropagator(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                         const std::vector<Neighbour>& neighbours);
+};
+
+}  // namespace SpaceRogueLite
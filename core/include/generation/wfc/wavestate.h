@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <fastwfc/utils/array2D.hpp>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "compiledtileset.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief The patterns still possible in each cell of a WFC solve, plus the bookkeeping to
+ * propagate and collapse them.
+ *
+ * Follows fast-wfc's WFC (lowest entropy cell first, weighted pattern choice) but keeps the state
+ * copyable and the seed out of it. Constraints every attempt shares can be applied and propagated
+ * once, then the state copied and solved with a different seed per attempt.
+ *
+ * Each cell's patterns are a packed bitset. Propagation is AC-3 over cells rather than patterns:
+ * when a cell changes, the patterns its neighbours may still be are the OR of the support masks
+ * of its patterns, ANDed into each neighbour a word at a time. Cells waiting to be observed sit
+ * in a min-heap keyed on entropy, stale entries being skipped as they come off it.
+ *
+ * Solving can backtrack instead of failing outright. Each observation is pushed on a decision
+ * stack and every cell changed after it recorded on a trail, so a contradiction undoes the latest
+ * decision and rules its pattern out. Once backtrackLimit backtracks are used up, the cells
+ * around the contradiction are reset to how they were when solving started and the search
+ * carries on from there. A limited number of resets are made per solve before it gives up.
+ */
+class WaveState {
+public:
+    WaveState(const CompiledTileSet& rules, int width, int height);
+
+    int getWidth(void) const;
+    int getHeight(void) const;
+
+    // Restricts cell (x, y) to one orientation of a tile, takes effect on the next propagate
+    bool setTile(int x, int y, unsigned tile, unsigned orientation);
+
+    // False if some cell has no patterns left
+    bool propagate(void);
+
+    // Collapses every cell, one pattern index per cell. 0 fails on the first contradiction
+    std::optional<Array2D<unsigned>> solve(int seed, int backtrackLimit = 0);
+
+    int getBacktrackCount(void) const;
+    int getRegionResetCount(void) const;
+
+private:
+    using Word = uint64_t;
+
+    static constexpr unsigned WORD_BITS = 64;
+    static constexpr int MAX_REGION_RESETS = 32;    // For the whole solve
+    static constexpr int INITIAL_RESET_RADIUS = 4;  // Doubles with each reset that fails
+
+    struct Decision {
+        size_t trailSize;  // Trail length before the decision, what undoing it returns to
+        size_t cell;
+        unsigned pattern;
+    };
+
+    // A cell as it was before a change, its words follow on trailDomains
+    struct Change {
+        size_t cell;
+        double weightSum;
+        double weightLogWeightSum;
+    };
+
+    using HeapEntry = std::pair<double, size_t>;  // Entropy plus noise, cell
+
+    const CompiledTileSet* rules;
+    int width;
+    int height;
+    unsigned patternCount;
+    unsigned wordCount;  // Words per bitset
+    bool isContradicted = false;
+
+    std::vector<Word> domains;       // [cell][word], the patterns still possible
+    std::vector<Word> supportMasks;  // [pattern][direction][word], allowed beside the pattern
+    std::vector<Word> allowedMask;   // Scratch space for propagation
+
+    // Per cell, kept up to date so entropies are cheap
+    std::vector<unsigned> possibleCounts;
+    std::vector<double> weightSums;
+    std::vector<double> weightLogWeightSums;
+    std::vector<double> entropies;
+
+    std::vector<double> weightLogWeights;  // Per pattern
+    double minHalfWeightLogWeight;         // Upper bound of the noise breaking entropy ties
+
+    std::vector<size_t> pendingCells;  // Changed cells whose neighbours need revising
+    std::vector<uint8_t> isPending;
+
+    // Only filled while solving
+    std::vector<double> noise;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> entropyHeap;
+
+    std::vector<Change> trail;
+    std::vector<Word> trailDomains;
+    bool isTrailing = false;
+    size_t contradictionCell = 0;
+
+    int backtrackCount = 0;
+    int regionResetCount = 0;
+
+    Word* getDomain(size_t cell);
+    const Word* getSupportMask(unsigned pattern, int direction) const;
+
+    // Removes every pattern from cell not set in allowed
+    void restrict(size_t cell, const Word* allowed);
+    void ban(size_t cell, unsigned pattern);
+    void collapse(size_t cell, unsigned pattern);
+
+    void undo(size_t trailSize);
+    bool recover(std::vector<Decision>& decisions, int backtrackLimit, int& backtracksSinceReset,
+                 const std::vector<Word>& initialDomains);
+    bool resetRegion(size_t cell, int radius, const std::vector<Word>& initialDomains);
+
+    void recountCell(size_t cell);
+    void updateCell(size_t cell);
+    void pushEntropy(size_t cell);
+    int findLowestEntropyCell(void);
+};
+
+}  // namespace SpaceRogueLite
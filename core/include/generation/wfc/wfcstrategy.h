@@ -9,29 +9,125 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <stop_token>
 #include <string>
+#include <tuple>
+#include <vector>
+#include "compiledtileset.h"
 #include "generation/generationstrategy.h"
+#include "utils/randomutils.h"
+#include "wavestate.h"
 #include "wfctileset.h"
 
 namespace SpaceRogueLite {
 
+/**
+ * @brief Generates maps by placing rooms and corridors, then filling in the rest with WFC.
+ *
+ * Attempts run in parallel on the shared thread pool, each with its own seed, solver and random
+ * generator, solvers all being created from the tile set's shared CompiledTileSet. The lowest
+ * numbered attempt to succeed wins, so the result is the same as running the attempts in order
+ * and the logged seed reproduces the map (see setSeed).
+ *
+ * Large maps are solved in overlapping blocks rather than in one go. Blocks are solved in four
+ * phases by the parity of their block coordinates, the blocks in a phase are far enough apart to
+ * be solved in parallel, and each block is constrained by the tiles its neighbours from earlier
+ * phases have already solved. A block which hits a contradiction is retried on its own.
+ *
+ * Each block is reported through the progress callback as it's solved (see
+ * GenerationStrategy::setProgressCallback). Maps solved whole are only reported by returning.
+ *
+ * Solves backtrack out of contradictions (see WaveState) rather than failing the attempt, so a
+ * bad choice costs a few cells instead of the whole map.
+ */
 class WFCStrategy : public GenerationStrategy {
 public:
+    struct AttemptReport {
+        enum Outcome { SUCCEEDED, CONTRADICTION, UNREACHABLE_ROOMS, CANCELLED };
+
+        int seed;
+        Outcome outcome;
+        double timeMs;
+    };
+
     WFCStrategy(const RoomConfiguration& roomConfiguration, const WFCTileSet& tileSet);
 
     std::vector<GridTile> generate(void) override;
 
+    // Makes a single attempt with this seed instead of random ones, to reproduce a logged map.
+    // Seeds only reproduce maps logged by a build with the same solver
+    void setSeed(int seed);
+
+    // Solves the map in blockSize square blocks, 0 (the default) only does so for large maps
+    void setBlockSize(int blockSize);
+
+    // Backtracks a solve may make before resetting the area around a contradiction, 0 gives up
+    // on the first contradiction and leaves it to the next attempt
+    void setBacktrackLimit(int backtrackLimit);
+
+    // Attempts made by the last generate, in attempt order
+    const std::vector<AttemptReport>& getAttemptReports(void) const;
+
 private:
-    std::optional<Array2D<WFCTileSet::WFCTile>> run(int numAttempts, int& successfulAttempt,
-                                                    int& seed);
-    std::optional<Array2D<WFCTileSet::WFCTile>> runAttempt(int seed);
+    static constexpr int NUM_ATTEMPTS = 10;
+
+    static constexpr int FREE_TILE = -1;
+    static constexpr int MAX_SINGLE_SOLVE_SIZE = 128;
+    static constexpr int DEFAULT_BLOCK_SIZE = 64;
+    static constexpr int BLOCK_OVERLAP = 4;
+    static constexpr int MAX_BLOCK_ATTEMPTS = 16;
+    static constexpr int DEFAULT_BACKTRACK_LIMIT = 32;
+    static constexpr uint64_t ROOM_STREAM = UINT64_MAX;  // Block streams split on coordinates
+
+    struct AttemptResult {
+        std::optional<std::vector<GridTile>> tiles;  // Row-major, ready for Grid::setTiles
+        std::vector<Room> rooms;
+        AttemptReport report;
+    };
+
+    std::optional<AttemptResult> run(const std::vector<int>& seeds, int& successfulAttempt);
+
+    // Attempts stop early when stopToken is triggered, but a WFC solve itself isn't interrupted so
+    // cancellation is checked either side of it
+    AttemptResult runAttempt(int seed, std::stop_token stopToken) const;
+
+    // Block size used for this map, 0 if it's solved whole
+    int getBlockSize(void) const;
+
+    // The map edge is the same for every attempt, so it's applied and propagated once per region
+    // shape before the attempts start and each solve copies the result
+    using BaseStateKey = std::tuple<int, int, int>;
+
+    bool createBaseStates(void);
+    BaseStateKey getBaseStateKey(const glm::ivec2& min, const glm::ivec2& max) const;
+    void getBlockRegion(const glm::ivec2& block, glm::ivec2& min, glm::ivec2& max) const;
+    void generateMapEdge(WaveState& wave, const glm::ivec2& min) const;
+
+    // fixedTiles holds the tile index each cell is fixed to by the attempt, or FREE_TILE
+    std::optional<std::vector<GridTile>> solve(const std::vector<int>& fixedTiles, int seed) const;
+    std::optional<std::vector<GridTile>> solveInBlocks(const std::vector<int>& fixedTiles, int seed,
+                                                       std::stop_token stopToken) const;
+    bool solveBlock(const std::vector<int>& fixedTiles, const glm::ivec2& block, int seed,
+                    std::vector<GridTile>& tiles, std::vector<uint8_t>& isSolved) const;
+
+    // Places as many of the configured rooms as fit, false if cancelled
+    bool generateRoomsAndPaths(std::vector<int>& fixedTiles, Utils::RandomGenerator& rng,
+                               std::vector<Room>& rooms, std::stop_token stopToken) const;
+
+    // WFC may wall a room off from the corridors, reject those maps before they're used
+    bool areRoomsConnected(const std::vector<GridTile>& tiles,
+                           const std::vector<Room>& rooms) const;
 
-    void generateMapEdge(TilingWFC<WFCTileSet::WFCTile>& wfc);
-    void generateRoomsAndPaths(TilingWFC<WFCTileSet::WFCTile>& wfc);
-    Room generateRoom(TilingWFC<WFCTileSet::WFCTile>& wfc, const std::vector<Room>& existingRooms);
-    Room createRandomRoom(void);
+    static const char* getOutcomeName(AttemptReport::Outcome outcome);
 
     WFCTileSet tileSet;
+    std::vector<unsigned> tileIndexByVariant;  // Solved tiles back to indices for set_tile
+    std::vector<GridTile> gridTileByPattern;
+    std::optional<int> fixedSeed;
+    int blockSize = 0;
+    int backtrackLimit = DEFAULT_BACKTRACK_LIMIT;
+    std::map<BaseStateKey, WaveState> baseStates;
+    std::vector<AttemptReport> attemptReports;
 };
 
 }  // namespace SpaceRogueLite
\ No newline at end of file
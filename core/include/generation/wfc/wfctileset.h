@@ -10,6 +10,7 @@
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -21,12 +22,22 @@ using json = nlohmann::json;
 
 namespace SpaceRogueLite {
 
+class CompiledTileSet;
+
+/**
+ * @brief Tiles and neighbour rules for WFC generation, read from a rules json file.
+ *
+ * The rules are compiled once on load into a CompiledTileSet, which copies of the tile set share.
+ * The parsed and compiled rules are cached in a binary file beside the rules file, keyed by a hash
+ * of its contents, so later loads of unchanged rules skip the json and the compile.
+ */
 class WFCTileSet : public TileSet {
 public:
     typedef struct _wfcTile {
         TileId tileId;
         Symmetry symmetry;
         std::string name;
+        TileVariantId variant;
         double weight;
         uint16_t textureId;
         uint8_t orientation;
@@ -36,11 +47,15 @@ public:
 
     const std::vector<Tile<WFCTile>>& getWFCTileVariants(void) const;
     const std::set<TileVariant>& getTileVariants(void) const override;
+    const TileVariantTable& getVariantTable(void) const override;
     const std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>>& getNeighbours(
         void) const;
 
+    // Only valid once loaded
+    const CompiledTileSet& getCompiledTileSet(void) const;
+
     const std::unordered_map<TileId, bool>& getWalkableTiles(void) const override;
-    GridTile::Walkability getTileWalkability(TileId id) override;
+    GridTile::Walkability getTileWalkability(TileId id) const override;
 
     unsigned getEdgeTileIndex(void) const override;
     unsigned getRoomTileIndex(void) const override;
@@ -49,6 +64,14 @@ public:
     void reset(void) override;
 
 private:
+    static constexpr uint32_t CACHE_FORMAT_VERSION = 1;
+
+    bool loadRules(const std::string& rules);
+    bool loadCache(uint64_t rulesHash);
+    void saveCache(uint64_t rulesHash) const;
+    std::string getCachePath(void) const;
+    void clearRules(void);
+
     Symmetry getSymmetry(const std::string& symmetry);
     static TileVariant::TextureSymmetry toTextureSymmetry(Symmetry symmetry);
 
@@ -65,6 +88,8 @@ private:
     std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>> neighbours;
     std::unordered_map<TileId, bool> walkableTiles;
     std::set<TileVariant> tileVariants;
+    TileVariantTable variantTable;
+    std::shared_ptr<const CompiledTileSet> compiledTileSet;
 
     unsigned edgeTileIndex;
     unsigned roomTileIndex;
@@ -1,17 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <fastwfc/wfc.hpp>
 #include <functional>
 #include <glm/glm.hpp>
-#include <string>
+#include <memory>
+#include <span>
+#include <type_traits>
 #include <vector>
 
+#include "walkabilitybitmap.h"
+#include "walkableregions.h"
+
 namespace SpaceRogueLite {
 
+class GridSnapshot;
+
 using TileId = uint16_t;  // Supports 65535 tile types
 constexpr TileId TILE_EMPTY = 0;
 
+using TileVariantId = uint16_t;  // Index into the owning TileSet's TileVariantTable
+constexpr TileVariantId TILE_VARIANT_NONE = 0;
+
 struct GridRegion {
     int x = 0;
     int y = 0;
@@ -26,59 +38,222 @@ struct GridTile {
     };
 
     TileId id = TILE_EMPTY;
-    std::string type = "";
+    TileVariantId variant = TILE_VARIANT_NONE;
     Walkability walkable = BLOCKED;
 
     // Rotation: 0, 1, 2, 3 -> 0, 90, 180, 270 degrees
     uint8_t orientation = 0;
 
     bool operator==(const GridTile& other) const {
-        return id == other.id && walkable == other.walkable && orientation == other.orientation &&
-               type == other.type;
+        return id == other.id && variant == other.variant && walkable == other.walkable &&
+               orientation == other.orientation;
     }
 
     bool operator!=(const GridTile& other) const { return !(*this == other); }
 };
 
-inline const GridTile TILE_DEFAULT = {TILE_EMPTY, "", GridTile::BLOCKED, 0};
+// Tiles are stored by value in every grid cell, keep them small and trivially copyable
+static_assert(sizeof(GridTile) <= 8);
+static_assert(std::is_trivially_copyable_v<GridTile>);
 
+inline constexpr GridTile TILE_DEFAULT = {TILE_EMPTY, TILE_VARIANT_NONE, GridTile::BLOCKED, 0};
+
+/**
+ * @brief Tile storage split into fixed size pages which are only allocated once written to.
+ *
+ * Pages which have never been written share a single empty sentinel page, so memory tracks the
+ * touched area of the map rather than its bounding box. Tiles outside of the grid bounds but
+ * inside an edge page are always kept as TILE_DEFAULT.
+ *
+ * Changes are tracked per CHUNK_SIZE chunk. Each system interested in changes registers its own
+ * dirty consumer, so consuming dirty chunks in one system doesn't hide them from the others.
+ *
+ * A 1 bit per tile walkability bitmap is kept alongside the tiles, along with the connected
+ * regions of walkable tiles so reachability checks are a label compare.
+ *
+ * Readers on other threads work from snapshots (see createSnapshot) rather than the grid itself.
+ */
 class Grid {
 public:
+    static constexpr int PAGE_SIZE = 32;
+    static constexpr int CHUNK_SIZE = 16;
+
+    using DirtyConsumerId = uint32_t;
+
+    struct TilePage {
+        std::array<GridTile, PAGE_SIZE * PAGE_SIZE> tiles;  // Row-major: tiles[y * PAGE_SIZE + x]
+    };
+
+    // The page table is persistent: rows and the table itself are shared with snapshots and only
+    // copied when written while shared, so a snapshot never copies the whole table
+    using PageRow = std::vector<std::shared_ptr<TilePage>>;  // pageCountX pages
+    using PageTable = std::vector<std::shared_ptr<PageRow>>;  // pageCountY rows
+
     Grid(int width, int height);
 
     void setTile(int x, int y, const GridTile& tile);
+    // Row-major: newTiles[y * newWidth + x]
     void setTiles(const std::vector<GridTile>& newTiles, int newWidth, int newHeight);
+    // Still copies the tiles into pages, taking the buffer only frees it as soon as they're built
+    // rather than leaving that to the caller
+    void setTiles(std::vector<GridTile>&& newTiles, int newWidth, int newHeight);
+    // Row-major: regionTiles[(y - region.y) * region.width + x - region.x], clipped to the grid.
+    // Only chunks whose tiles actually change are marked dirty
+    void setRegion(const GridRegion& region, std::span<const GridTile> regionTiles);
+
+    // Adopts ready built pages, row-major by page. Null pages are left empty. Tiles outside of the
+    // new bounds must already be TILE_DEFAULT. Pages still held elsewhere are copied on write
+    void setPages(std::vector<std::shared_ptr<TilePage>> newPages, int newWidth, int newHeight);
     GridTile getTile(int x, int y) const;
 
     int getWidth() const;
     int getHeight() const;
+    GridRegion getBounds() const;
     void resize(int newWidth, int newHeight);
 
-    bool isDirty() const;
-    GridRegion getDirtyRegion() const;
-    void clearDirty();
+    int getChunkCountX() const;
+    int getChunkCountY() const;
+
+    // New consumers start with every chunk marked dirty
+    DirtyConsumerId registerDirtyConsumer();
+    void unregisterDirtyConsumer(DirtyConsumerId consumer);
+
+    bool isDirty(DirtyConsumerId consumer) const;
+    void forEachDirtyChunk(DirtyConsumerId consumer,
+                           std::function<void(int chunkX, int chunkY)> callback) const;
+    void consumeDirtyChunks(DirtyConsumerId consumer,
+                            std::function<void(int chunkX, int chunkY)> callback);
+    void clearDirty(DirtyConsumerId consumer);
     void markAllDirty();
 
-    void forEachTile(std::function<void(int x, int y, const GridTile&)> callback) const;
+    // Calls visitor(x, y, tile) in row-major order, regions are clipped to the grid
+    template <typename Visitor>
+    void forEachTile(Visitor&& visitor) const;
+    template <typename Visitor>
+    void forEachTile(const GridRegion& region, Visitor&& visitor) const;
+
+    // Tiles are only contiguous along a row within a page, so each row of the region is visited as
+    // spans that break at page boundaries: visitor(x, y, tiles) where tiles[i] is (x + i, y)
+    template <typename Visitor>
+    void forEachRowSpan(const GridRegion& region, Visitor&& visitor) const;
+
+    // Tiles from (x, y) to the end of its page row, clipped to the grid. Empty outside of the grid
+    std::span<const GridTile> getRowSpan(int x, int y) const;
+
+    // Immutable view of the current tiles which shares the page table with the grid. Whatever a
+    // live snapshot holds is copied on its next write, so a snapshot costs the pages written while
+    // it's held, the page table rows they sit in and the table's row list, not the whole table.
+    // Snapshots are safe to read from any thread, but have to be created on the thread writing to
+    // the grid
+    std::shared_ptr<const GridSnapshot> createSnapshot();
+    uint64_t getVersion() const;  // Bumped whenever tiles change
+
+    const WalkabilityBitmap& getWalkability() const;
+    bool isWalkable(int x, int y) const;
+
+    // Region labels are brought up to date lazily by the lookups below, which makes them unsafe to
+    // call from several threads at once. Call updateRegions() first when sharing the grid between
+    // threads. Region ids change whenever walkability does
+    void updateRegions() const;
+    int32_t getRegion(int x, int y) const;  // WalkableRegions::NO_REGION for blocked tiles
+    bool isReachable(const glm::ivec2& from, const glm::ivec2& to) const;
+    size_t getRegionCount() const;
 
-    std::vector<glm::ivec2> getIntersections(const glm::vec2& p1, const glm::vec2& p2);
+    int getPageCountX() const;
+    int getPageCountY() const;
+    std::size_t getAllocatedPageCount() const;
+
+    // Visits allocated pages only, pages which are still the empty sentinel are skipped
+    void forEachPage(std::function<void(int pageX, int pageY, const TilePage&)> callback) const;
+
+    // Cells crossed by the segment p1 -> p2, clipped to the grid. See traverseGrid in
+    // gridtraversal.h for an allocation free alternative
+    std::vector<glm::ivec2> getIntersections(const glm::vec2& p1, const glm::vec2& p2) const;
 
 private:
+    friend class GridSnapshot;
+
     int width;
     int height;
-    std::vector<GridTile> tiles;  // Row-major: tiles[y * width + x]
+    int pageCountX = 0;
+    int pageCountY = 0;
+    std::shared_ptr<PageTable> pageTable;  // (*(*pageTable)[pageY])[pageX]
+
+    struct DirtyTracker {
+        bool active = false;
+        std::vector<uint64_t> bits;   // One bit per chunk: bits[index / 64] & (1 << index % 64)
+        std::vector<uint32_t> dirty;  // Indices of the set bits, in the order they were dirtied
+    };
+
+    int chunkCountX = 0;
+    int chunkCountY = 0;
+    std::vector<DirtyTracker> dirtyTrackers;  // Indexed by DirtyConsumerId
 
-    bool dirty = false;
-    GridRegion dirtyRegion{0, 0, 0, 0};
+    WalkabilityBitmap walkability;
+    mutable WalkableRegions regions;
 
-    void expandDirtyRegion(int x, int y);
+    uint64_t version = 0;
+    std::weak_ptr<const GridSnapshot> lastSnapshot;  // Handed out again until the tiles change
+
+    void markChunkDirty(int x, int y);
+    void resetDirtyTracker(DirtyTracker& tracker);
+    void rebuildWalkability();
     bool isValidPosition(int x, int y) const;
 
-    // Line intersection
-    float pointOnLineSide(const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& point);
-    bool hasPointsOnDifferentSides(const glm::vec2& p1, const glm::vec2& p2,
-                                   const std::vector<glm::vec2>& corners);
-    bool hasTileIntersection(const glm::vec2& p1, const glm::vec2& p2, int x, int y);
+    static const std::shared_ptr<TilePage>& getEmptyPage();
+    static std::shared_ptr<PageTable> createPageTable(int pageCountX, int pageCountY);
+    bool isEmptyPage(const std::shared_ptr<TilePage>& page) const;
+    const std::shared_ptr<TilePage>& getPageSlot(int pageX, int pageY) const;
+    const TilePage& getPage(int x, int y) const;
+    TilePage& getWritablePage(int x, int y);
+    void clearPageOutsideBounds(int pageX, int pageY);
+
+    template <typename Visitor>
+    static void forEachPageRowSpan(const PageTable& pageTable, int width, int height,
+                                   const GridRegion& region, Visitor&& visitor);
 };
 
+template <typename Visitor>
+void Grid::forEachTile(Visitor&& visitor) const {
+    forEachTile(getBounds(), visitor);
+}
+
+template <typename Visitor>
+void Grid::forEachTile(const GridRegion& region, Visitor&& visitor) const {
+    forEachRowSpan(region, [&visitor](int x, int y, std::span<const GridTile> tiles) {
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            visitor(x + static_cast<int>(i), y, tiles[i]);
+        }
+    });
+}
+
+template <typename Visitor>
+void Grid::forEachRowSpan(const GridRegion& region, Visitor&& visitor) const {
+    forEachPageRowSpan(*pageTable, width, height, region, visitor);
+}
+
+template <typename Visitor>
+void Grid::forEachPageRowSpan(const PageTable& pageTable, int width, int height,
+                              const GridRegion& region, Visitor&& visitor) {
+    const int startX = std::max(0, region.x);
+    const int startY = std::max(0, region.y);
+    const int endX = std::min(width, region.x + region.width);
+    const int endY = std::min(height, region.y + region.height);
+
+    for (int y = startY; y < endY; ++y) {
+        const auto& pageRow = *pageTable[y / PAGE_SIZE];
+        const size_t rowOffset = (y % PAGE_SIZE) * PAGE_SIZE;
+
+        for (int x = startX; x < endX;) {
+            const int length = std::min(endX, (x / PAGE_SIZE + 1) * PAGE_SIZE) - x;
+            const auto& page = *pageRow[x / PAGE_SIZE];
+
+            visitor(x, y,
+                    std::span<const GridTile>(page.tiles.data() + rowOffset + x % PAGE_SIZE,
+                                              static_cast<size_t>(length)));
+            x += length;
+        }
+    }
+}
+
 }  // namespace SpaceRogueLite
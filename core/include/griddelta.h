@@ -0,0 +1,47 @@
+#pragma once
+
+#include <grid.h>
+#include <gridsnapshot.h>
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Compact encoding of changed grid chunks, for keeping a remote copy of a grid in step.
+ *
+ * A delta carries the grid size and a list of CHUNK_SIZE chunks. Each chunk is a palette of its
+ * distinct tiles followed by either runs of palette indices or the indices packed one per tile,
+ * whichever is smaller, using as few bits as the palette needs. When diffing two snapshots a chunk
+ * with a few changes sends just the changed tiles and their positions instead.
+ *
+ * Encoding splits a change set into deltas of at most maxBytes (a chunk is never split, a single
+ * chunk encodes to at most MAX_CHUNK_BYTES). Every delta applies on its own, in order.
+ */
+class GridDelta {
+public:
+    static constexpr size_t HEADER_BYTES = 11;
+    static constexpr size_t MAX_CHUNK_BYTES = 1382;
+
+    // Deltas turning previous into current, empty if nothing changed. Without a previous snapshot
+    // the first delta clears the receiving grid and every chunk that isn't TILE_DEFAULT is sent
+    static std::vector<std::vector<uint8_t>> encode(const GridSnapshot& current,
+                                                    const GridSnapshot* previous, size_t maxBytes);
+
+    // Deltas for the given chunks, for example a grid dirty consumer's chunks
+    static std::vector<std::vector<uint8_t>> encodeChunks(const GridSnapshot& current,
+                                                          const std::vector<glm::ivec2>& chunks,
+                                                          bool isReset, size_t maxBytes);
+
+    // Resizes the grid to the delta's size and writes its chunks. Nothing is written if the delta
+    // is malformed
+    static bool apply(Grid& grid, std::span<const uint8_t> delta);
+
+    // True if applying the delta clears the grid first, i.e. it starts a whole new map
+    static bool isReset(std::span<const uint8_t> delta);
+};
+
+}  // namespace SpaceRogueLite
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <grid.h>
+#include <gridsnapshot.h>
+#include <tilevariant.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Binary map files, memory mapped and decoded a page at a time.
+ *
+ * Layout (little endian):
+ *   Header
+ *   Variant table: variantCount x (uint16 length, name bytes), the TileVariantTable types
+ *   Page index: pageCountX * pageCountY x PageIndexEntry, row-major
+ *   Page payloads: RLE runs over the page's in-bounds tiles, row-major
+ *
+ * Pages match Grid::PAGE_SIZE so decoded pages are handed to the Grid as they are. Pages that are
+ * entirely TILE_DEFAULT have no payload and stay as the grid's empty page. Variants are stored by
+ * name and mapped through the loading tile set's table, so files survive variant reordering.
+ *
+ * Pages are decoded on first access and kept until loadInto gives them away. loadInto decodes on
+ * the shared thread pool, but the GridFile itself is not thread safe.
+ */
+class GridFile {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    GridFile();
+    ~GridFile();
+
+    GridFile(const GridFile&) = delete;
+    GridFile& operator=(const GridFile&) = delete;
+
+    static bool save(const std::string& path, const GridSnapshot& snapshot,
+                     const TileVariantTable& variantTable);
+
+    // Maps the file and reads the header and index, pages aren't touched until needed
+    bool open(const std::string& path, const TileVariantTable& variantTable);
+    void close(void);
+    bool isOpen(void) const;
+
+    int getWidth(void) const;
+    int getHeight(void) const;
+
+    GridTile getTile(int x, int y);
+    std::shared_ptr<Grid::TilePage> getPage(int pageX, int pageY);  // Null if the page is empty
+
+    // Decodes every remaining page and hands them all to the grid, the file keeping none of them
+    bool loadInto(Grid& grid);
+
+    size_t getDecodedPageCount(void) const;
+
+private:
+    static constexpr size_t PARALLEL_PAGE_COUNT = 64;
+
+    struct EncodedRun {
+        uint16_t length;
+        TileId id;
+        TileVariantId variant;
+        uint8_t walkable;
+        uint8_t orientation;
+    };
+
+    struct Mapping;
+
+    struct PageIndexEntry {
+        uint64_t offset;
+        uint32_t size;  // Bytes of payload, 0 for empty pages
+        uint32_t runCount;
+    };
+
+    std::unique_ptr<Mapping> mapping;
+
+    int width = 0;
+    int height = 0;
+    int pageCountX = 0;
+    int pageCountY = 0;
+
+    std::vector<PageIndexEntry> pageIndex;
+    std::vector<TileVariantId> variantRemap;  // File variant -> loading table variant
+
+    std::vector<std::shared_ptr<Grid::TilePage>> pages;
+    std::vector<uint8_t> isDecoded;
+    size_t decodedPageCount = 0;
+
+    // Interior pages made of a single run share one decoded page per tile
+    std::unordered_map<uint64_t, std::shared_ptr<Grid::TilePage>> uniformPages;
+
+    bool readHeader(const TileVariantTable& variantTable);
+    bool isUniformPage(int pageX, int pageY, GridTile& tile) const;
+    std::shared_ptr<Grid::TilePage> decodePage(int pageX, int pageY);
+    std::shared_ptr<Grid::TilePage> decodeRuns(int pageX, int pageY) const;  // Thread safe
+    GridTile decodeTile(const EncodedRun& run) const;
+};
+
+}  // namespace SpaceRogueLite
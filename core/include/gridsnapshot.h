@@ -0,0 +1,75 @@
+#pragma once
+
+#include <grid.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Immutable, versioned view of a Grid's tiles at the time it was taken.
+ *
+ * Created by Grid::createSnapshot. Shares the page table and tile pages with the grid (and with
+ * other snapshots), the grid copies whatever a snapshot still holds before writing to it. Safe to
+ * read from any number of threads while the grid keeps changing.
+ */
+class GridSnapshot {
+public:
+    GridSnapshot(uint64_t version, int width, int height,
+                 std::shared_ptr<const Grid::PageTable> pageTable);
+
+    uint64_t getVersion() const;
+    int getWidth() const;
+    int getHeight() const;
+    GridRegion getBounds() const;
+
+    GridTile getTile(int x, int y) const;
+    std::span<const GridTile> getRowSpan(int x, int y) const;
+
+    // See the matching Grid views
+    template <typename Visitor>
+    void forEachTile(Visitor&& visitor) const;
+    template <typename Visitor>
+    void forEachTile(const GridRegion& region, Visitor&& visitor) const;
+    template <typename Visitor>
+    void forEachRowSpan(const GridRegion& region, Visitor&& visitor) const;
+
+    // Chunks whose tiles differ from an earlier snapshot of the same grid. Only rows and pages
+    // replaced since then are looked at, if the size changed every chunk is reported
+    void forEachChangedChunk(const GridSnapshot& previous,
+                             std::function<void(int chunkX, int chunkY)> callback) const;
+
+private:
+    uint64_t version;
+    int width;
+    int height;
+    std::shared_ptr<const Grid::PageTable> pageTable;  // Never written through
+
+    bool isValidPosition(int x, int y) const;
+    const Grid::TilePage& getPage(int x, int y) const;
+};
+
+template <typename Visitor>
+void GridSnapshot::forEachTile(Visitor&& visitor) const {
+    forEachTile(getBounds(), visitor);
+}
+
+template <typename Visitor>
+void GridSnapshot::forEachTile(const GridRegion& region, Visitor&& visitor) const {
+    forEachRowSpan(region, [&visitor](int x, int y, std::span<const GridTile> tiles) {
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            visitor(x + static_cast<int>(i), y, tiles[i]);
+        }
+    });
+}
+
+template <typename Visitor>
+void GridSnapshot::forEachRowSpan(const GridRegion& region, Visitor&& visitor) const {
+    Grid::forEachPageRowSpan(*pageTable, width, height, region, visitor);
+}
+
+}  // namespace SpaceRogueLite
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <type_traits>
+
+namespace SpaceRogueLite {
+
+enum class TraversalMode {
+    // Only cells whose interior the segment passes through
+    THIN,
+    // Also includes both side cells when the segment passes exactly through a cell corner
+    SUPERCOVER,
+};
+
+namespace detail {
+
+template <typename Visitor>
+inline bool visitTraversalCell(Visitor& visitor, int x, int y) {
+    if constexpr (std::is_void_v<std::invoke_result_t<Visitor&, int, int>>) {
+        visitor(x, y);
+        return true;
+    } else {
+        return visitor(x, y);
+    }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Walks the grid cells crossed by the segment p1 -> p2 in order (Amanatides & Woo).
+ *
+ * Positions are in tile coordinates with tile centres on integer positions, so the cell (x, y)
+ * covers [x - 0.5, x + 0.5) x [y - 0.5, y + 0.5). The traversal does not allocate and is not
+ * clipped to any grid bounds.
+ *
+ * The visitor is called as visitor(x, y) and may return bool, returning false stops the
+ * traversal early.
+ *
+ * @return false if the visitor stopped the traversal, true otherwise
+ */
+template <typename Visitor>
+inline bool traverseGrid(const glm::vec2& p1, const glm::vec2& p2, TraversalMode mode,
+                         Visitor&& visitor) {
+    // Offset so cell boundaries fall on integer positions. Coordinates are widened to double so
+    // the boundary comparisons below are exact for float inputs, which keeps corner crossings
+    // (and so THIN vs SUPERCOVER) consistent regardless of segment direction
+    double startX = static_cast<double>(p1.x) + 0.5;
+    double startY = static_cast<double>(p1.y) + 0.5;
+    double dx = static_cast<double>(p2.x) - p1.x;
+    double dy = static_cast<double>(p2.y) - p1.y;
+    double absDx = std::abs(dx);
+    double absDy = std::abs(dy);
+
+    int x = static_cast<int>(std::floor(startX));
+    int y = static_cast<int>(std::floor(startY));
+    int endX = static_cast<int>(std::floor(static_cast<double>(p2.x) + 0.5));
+    int endY = static_cast<int>(std::floor(static_cast<double>(p2.y) + 0.5));
+
+    int stepX = dx > 0 ? 1 : (dx < 0 ? -1 : 0);
+    int stepY = dy > 0 ? 1 : (dy < 0 ? -1 : 0);
+
+    if (!detail::visitTraversalCell(visitor, x, y)) {
+        return false;
+    }
+
+    while (x != endX || y != endY) {
+        // Parametric distance to the next vertical/horizontal boundary, both scaled by |dx||dy|
+        double crossX = std::abs((stepX > 0 ? x + 1 : x) - startX) * absDy;
+        double crossY = std::abs((stepY > 0 ? y + 1 : y) - startY) * absDx;
+
+        bool stepInX = x != endX && (y == endY || crossX <= crossY);
+        bool stepInY = y != endY && (x == endX || crossY <= crossX);
+
+        if (stepInX && stepInY) {
+            // Passing exactly through a corner
+            if (mode == TraversalMode::SUPERCOVER) {
+                if (!detail::visitTraversalCell(visitor, x + stepX, y) ||
+                    !detail::visitTraversalCell(visitor, x, y + stepY)) {
+                    return false;
+                }
+            }
+
+            x += stepX;
+            y += stepY;
+        } else if (stepInX) {
+            x += stepX;
+        } else {
+            y += stepY;
+        }
+
+        if (!detail::visitTraversalCell(visitor, x, y)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace SpaceRogueLite
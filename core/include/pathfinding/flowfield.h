@@ -0,0 +1,128 @@
+#pragma once
+
+#include <grid.h>
+#include <walkabilitybitmap.h>
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Distance to the nearest goal and the step towards it for every tile on the grid.
+ *
+ * Tiles that can't reach a goal have an infinite distance and no direction, as do the goals.
+ */
+struct FlowField {
+    static constexpr float UNREACHABLE = std::numeric_limits<float>::infinity();
+
+    int width = 0;
+    int height = 0;
+    std::vector<int32_t> goals;          // Sorted tile indices, y * width + x
+    std::vector<float> distances;        // By tile index
+    std::vector<int32_t> sources;        // Tile index of the goal each tile's distance leads to
+    std::vector<int8_t> directions;      // Index into FlowField::getStep, -1 for none
+    std::vector<uint8_t> reachedChunks;  // Grid chunks holding at least one reachable tile
+
+    bool isReachable(int x, int y) const { return getDistance(x, y) != UNREACHABLE; }
+
+    float getDistance(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return UNREACHABLE;
+        }
+
+        return distances[y * width + x];
+    }
+
+    // (0, 0) on goals and tiles that can't reach one
+    glm::ivec2 getDirection(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return glm::ivec2(0, 0);
+        }
+
+        return getStep(directions[y * width + x]);
+    }
+
+    static glm::ivec2 getStep(int8_t direction) {
+        static constexpr int STEPS[8][2] = {{1, 0}, {-1, 0}, {0, 1},  {0, -1},
+                                            {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+        return direction < 0 ? glm::ivec2(0, 0)
+                             : glm::ivec2(STEPS[direction][0], STEPS[direction][1]);
+    }
+};
+
+/**
+ * @brief Builds and caches flow fields (multi-source Dijkstra maps) so crowds heading to the same
+ * goals share one search instead of running a path query each.
+ *
+ * Fields are built by relaxing grid chunks until nothing changes, with chunks that don't touch
+ * each other relaxed in parallel. They're cached by goal set, a request for a goal set a few goals
+ * away from a cached one is derived from it by only recomputing the tiles those goals affect.
+ * Cached fields are dropped when a grid chunk they reach (or border) is dirtied.
+ *
+ * Movement matches Pathfinder: 8-directional, without cutting corners. Not thread safe.
+ */
+class FlowFieldService {
+public:
+    explicit FlowFieldService(Grid& grid);
+    ~FlowFieldService();
+
+    FlowFieldService(const FlowFieldService&) = delete;
+    FlowFieldService& operator=(const FlowFieldService&) = delete;
+
+    // Drops the fields affected by grid changes. Called automatically by getFlowField
+    void update(void);
+
+    // Goals that aren't walkable are ignored. The field stays valid for as long as the caller
+    // holds it, but won't see grid changes made after it was returned
+    std::shared_ptr<const FlowField> getFlowField(const std::vector<glm::ivec2>& goals);
+
+    void clearCache(void);
+    size_t getCachedFieldCount(void) const;
+    size_t getLastRelaxedChunkCount(void) const;
+    const WalkabilityBitmap& getWalkability(void) const;
+
+private:
+    static constexpr size_t MAX_CACHED_FIELDS = 16;
+    static constexpr size_t MAX_INCREMENTAL_GOAL_CHANGES = 8;
+    static constexpr size_t PARALLEL_CHUNK_COUNT = 4;
+    static constexpr float DISTANCE_BAND = 2.0f * Grid::CHUNK_SIZE;
+
+    struct CacheEntry {
+        std::shared_ptr<FlowField> field;
+        uint64_t lastUsed;
+    };
+
+    Grid& grid;
+    Grid::DirtyConsumerId dirtyConsumer;
+    const WalkabilityBitmap& walkability;  // Owned by the grid
+
+    int chunkCountX = 0;
+    int chunkCountY = 0;
+
+    std::vector<CacheEntry> cache;
+    uint64_t useCounter = 0;
+    size_t lastRelaxedChunkCount = 0;
+
+    std::shared_ptr<FlowField> createFlowField(const std::vector<int32_t>& goals);
+    std::shared_ptr<FlowField> deriveFlowField(const FlowField& previous,
+                                               const std::vector<int32_t>& goals);
+
+    void propagate(FlowField& field, const std::vector<uint8_t>& seededChunks);
+    // Returns the smallest distance the chunk changed or seeded, UNREACHABLE if it's unchanged
+    float relaxChunk(FlowField& field, int chunkX, int chunkY, bool isSeeded) const;
+    void updateDirections(FlowField& field, int chunkX, int chunkY) const;
+
+    void invalidateChunks(const std::vector<uint8_t>& isDirtyChunk);
+
+    void forEachNeighbourChunk(int32_t chunk, const std::function<void(int32_t)>& callback) const;
+    int getChunkIndex(int32_t tile) const;
+    bool canMove(int x, int y, int dx, int dy) const;
+};
+
+}  // namespace SpaceRogueLite
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <grid.h>
+#include <walkabilitybitmap.h>
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "pathfinding/pathfinder.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief HPA* pathfinding, routing over an abstract graph of cluster entrances before refining
+ * the route tile by tile inside each cluster.
+ *
+ * Clusters line up with the grid's dirty chunks (and so the renderer's chunks). Each cluster
+ * stores its entrances, the tiles either side of walkable stretches along its borders, and the
+ * costs between every pair of them. Only clusters touching dirty chunks are rebuilt on update().
+ *
+ * Paths use the same 8-directional, no corner cutting movement as Pathfinder but are only near
+ * optimal, since they are forced through entrances. Not thread safe.
+ */
+class HierarchicalPathfinder {
+public:
+    static constexpr int CLUSTER_SIZE = Grid::CHUNK_SIZE;
+
+    explicit HierarchicalPathfinder(Grid& grid);
+    ~HierarchicalPathfinder();
+
+    HierarchicalPathfinder(const HierarchicalPathfinder&) = delete;
+    HierarchicalPathfinder& operator=(const HierarchicalPathfinder&) = delete;
+
+    // Rebuilds the clusters touched by grid changes. Called automatically by findPath
+    void update(void);
+
+    // PathResult::expandedNodes counts abstract graph nodes rather than tiles
+    bool findPath(const glm::ivec2& start, const glm::ivec2& goal, PathResult& result);
+
+    size_t getEntranceCount(void) const;
+    size_t getLastRebuiltClusterCount(void) const;
+    const WalkabilityBitmap& getWalkability(void) const;
+
+private:
+    static constexpr int CLUSTER_AREA = CLUSTER_SIZE * CLUSTER_SIZE;
+    static constexpr int MAX_ENTRANCES = 4 * CLUSTER_SIZE;
+
+    // Walkable stretches along a border at least this long get an entrance at each end rather
+    // than one in the middle
+    static constexpr int ENTRANCE_SPLIT_LENGTH = 6;
+
+    struct Cluster {
+        glm::ivec2 min;
+        glm::ivec2 max;  // Inclusive, clusters on the far edges may be clipped by the grid
+        std::vector<glm::ivec2> entrances;
+        std::vector<float> distances;  // distances[i * entrances.size() + j], i to j
+        std::array<int8_t, CLUSTER_AREA> entranceIndex;  // By local tile, -1 if not an entrance
+    };
+
+    // Dijkstra results over the tiles of a single cluster, indexed by local tile
+    struct ClusterSearch {
+        std::array<float, CLUSTER_AREA> distances;
+        std::array<int16_t, CLUSTER_AREA> parents;
+    };
+
+    struct AbstractNode {
+        float g;
+        int32_t parent;  // -1 for nodes reached straight from the start tile
+        uint32_t generation;
+        bool closed;
+    };
+
+    Grid& grid;
+    Grid::DirtyConsumerId dirtyConsumer;
+    const WalkabilityBitmap& walkability;  // Owned by the grid
+
+    int clusterCountX = 0;
+    int clusterCountY = 0;
+    std::vector<Cluster> clusters;
+    size_t lastRebuiltClusterCount = 0;
+
+    std::vector<AbstractNode> abstractNodes;  // By cluster * MAX_ENTRANCES + entrance, then goal
+    std::vector<std::pair<float, int32_t>> openSet;
+    uint32_t generation = 0;
+
+    void rebuildAllClusters(void);
+    void rebuildCluster(int clusterX, int clusterY);
+    void addBorderEntrances(Cluster& cluster, const glm::ivec2& from, const glm::ivec2& along,
+                            const glm::ivec2& outward, int length);
+
+    void searchCluster(const Cluster& cluster, const glm::ivec2& source,
+                       ClusterSearch& search) const;
+    void appendClusterPath(const Cluster& cluster, const ClusterSearch& search,
+                           const glm::ivec2& to, std::vector<glm::ivec2>& path) const;
+    void refinePath(const std::vector<glm::ivec2>& waypoints, const ClusterSearch& startSearch,
+                    const ClusterSearch& goalSearch, PathResult& result) const;
+
+    int32_t getClusterIndex(const glm::ivec2& position) const;
+    int getLocalIndex(const Cluster& cluster, const glm::ivec2& position) const;
+    bool canMove(int x, int y, int dx, int dy) const;
+};
+
+}  // namespace SpaceRogueLite
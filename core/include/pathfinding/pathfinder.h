@@ -0,0 +1,111 @@
+#pragma once
+
+#include <grid.h>
+#include <walkabilitybitmap.h>
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+struct PathQuery {
+    glm::ivec2 start;
+    glm::ivec2 goal;
+};
+
+struct PathResult {
+    bool found = false;
+    float cost = 0.0f;
+    uint32_t expandedNodes = 0;
+    std::vector<glm::ivec2> path;  // Every tile from start to goal inclusive
+};
+
+/**
+ * @brief 8-directional grid pathfinding over grid walkability.
+ *
+ * Diagonal moves cost sqrt(2) and are only allowed when both adjacent orthogonal tiles are
+ * walkable, so paths never cut corners. Search state lives in reusable workspaces (a node pool
+ * invalidated by generation stamps plus an indexed binary heap), so once warmed up queries don't
+ * allocate beyond growing the caller's PathResult::path.
+ *
+ * JUMP_POINT mode runs Jump Point Search, which returns paths of the same cost as ASTAR on these
+ * uniform cost grids while expanding far fewer nodes.
+ *
+ * Queries between different walkable regions of the grid fail straight away without searching.
+ */
+class Pathfinder {
+public:
+    enum Mode : uint8_t {
+        ASTAR,
+        JUMP_POINT,
+    };
+
+    explicit Pathfinder(Grid& grid);
+
+    Pathfinder(const Pathfinder&) = delete;
+    Pathfinder& operator=(const Pathfinder&) = delete;
+
+    // Brings the grid's region labels up to date. Called automatically by the queries
+    void update(void);
+
+    bool findPath(const glm::ivec2& start, const glm::ivec2& goal, Mode mode, PathResult& result);
+
+    // Runs the queries across the shared thread pool, results[i] is the result for queries[i]
+    void findPaths(const std::vector<PathQuery>& queries, Mode mode,
+                   std::vector<PathResult>& results);
+
+    const WalkabilityBitmap& getWalkability(void) const;
+
+private:
+    static constexpr size_t PARALLEL_QUERY_COUNT = 8;
+
+    struct Node {
+        float g;
+        float f;
+        int32_t parent;
+        int32_t heapIndex;  // -1 when not in the open set
+        uint32_t generation;
+        bool closed;
+    };
+
+    struct Workspace {
+        std::vector<Node> nodes;     // Indexed by y * width + x
+        std::vector<int32_t> heap;   // Node indices, min-heap on (f, -g)
+        uint32_t generation = 0;
+    };
+
+    Grid& grid;
+    const WalkabilityBitmap& walkability;  // Owned by the grid
+
+    std::mutex workspaceMutex;
+    std::vector<std::unique_ptr<Workspace>> freeWorkspaces;
+
+    std::unique_ptr<Workspace> acquireWorkspace(void);
+    void releaseWorkspace(std::unique_ptr<Workspace> workspace);
+
+    void search(Workspace& workspace, const glm::ivec2& start, const glm::ivec2& goal, Mode mode,
+                PathResult& result) const;
+
+    void expandNeighbours(Workspace& workspace, int32_t current, int32_t goal) const;
+    void expandJumpPoints(Workspace& workspace, int32_t current, int32_t goal) const;
+    int32_t jump(int x, int y, int dx, int dy, int32_t goal) const;
+    void relax(Workspace& workspace, int32_t from, int32_t to, int32_t goal) const;
+
+    void buildPath(const Workspace& workspace, int32_t goal, PathResult& result) const;
+
+    bool isWalkable(int x, int y) const { return walkability.isWalkable(x, y); }
+    bool canMove(int x, int y, int dx, int dy) const;
+    float heuristic(int32_t from, int32_t to) const;
+
+    // Indexed binary heap
+    void heapPush(Workspace& workspace, int32_t node) const;
+    int32_t heapPop(Workspace& workspace) const;
+    void heapSiftUp(Workspace& workspace, int32_t position) const;
+    void heapSiftDown(Workspace& workspace, int32_t position) const;
+    bool heapLess(const Workspace& workspace, int32_t a, int32_t b) const;
+};
+
+}  // namespace SpaceRogueLite
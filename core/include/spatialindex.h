@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "components.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Spatial hash over the Position of every entity in a registry, for "what's near here"
+ * queries without scanning every entity.
+ *
+ * Entities are bucketed into square cells of cellSize tiles. The index follows the registry
+ * through its Position construct, update and destroy signals, so positions must be changed with
+ * registry.replace or registry.patch (not by writing through a reference) for the index to see
+ * the move. Not thread safe.
+ */
+class SpatialIndex {
+public:
+    static constexpr int DEFAULT_CELL_SIZE = 8;
+
+    explicit SpatialIndex(entt::registry& registry, int cellSize = DEFAULT_CELL_SIZE);
+    ~SpatialIndex();
+
+    SpatialIndex(const SpatialIndex&) = delete;
+    SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+    // Re-indexes every entity with a Position, for registries populated before the index existed
+    void rebuild(void);
+
+    // Results are cleared first. Distances are Euclidean, in tiles
+    void queryRadius(const Position& centre, int radius, std::vector<entt::entity>& results) const;
+    void queryRect(const glm::ivec2& min, const glm::ivec2& max,
+                   std::vector<entt::entity>& results) const;  // Inclusive of max
+    void queryNearest(const Position& centre, size_t count,
+                      std::vector<entt::entity>& results) const;  // Closest first
+
+    size_t getEntityCount(void) const;
+    int getCellSize(void) const;
+
+private:
+    struct CellEntity {
+        entt::entity entity;
+        Position position;
+    };
+
+    struct Entry {
+        uint64_t cell;
+        uint32_t slot;  // Index in the cell's entity list
+    };
+
+    entt::registry& registry;
+    int cellSize;
+
+    std::unordered_map<uint64_t, std::vector<CellEntity>> cells;  // Keyed by getCellKey
+    std::unordered_map<entt::entity, Entry> entries;
+
+    // Bounds of every cell that has held an entity, so nearest searches know when to give up
+    glm::ivec2 minCell{0, 0};
+    glm::ivec2 maxCell{-1, -1};
+
+    void onConstruct(entt::registry& registry, entt::entity entity);
+    void onUpdate(entt::registry& registry, entt::entity entity);
+    void onDestroy(entt::registry& registry, entt::entity entity);
+
+    void insert(entt::entity entity, const Position& position);
+    void remove(entt::entity entity);
+
+    template <typename Visitor>
+    void forEachInCells(const glm::ivec2& minCellPosition, const glm::ivec2& maxCellPosition,
+                        Visitor&& visitor) const;
+
+    glm::ivec2 getCell(const Position& position) const;
+    static uint64_t getCellKey(const glm::ivec2& cell);
+};
+
+}  // namespace SpaceRogueLite
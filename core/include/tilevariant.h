@@ -3,36 +3,86 @@
 #include <grid.h>
 
 #include <cstdint>
-#include <functional>
+#include <limits>
+#include <optional>
 #include <string>
-#include <utility>
+#include <unordered_map>
+#include <vector>
 
 namespace SpaceRogueLite {
 
-using TileVariantKey = std::pair<TileId, std::string>;
-
-struct TileVariantKeyHash {
-    std::size_t operator()(const TileVariantKey& key) const {
-        std::size_t h1 = std::hash<TileId>{}(key.first);
-        std::size_t h2 = std::hash<std::string>{}(key.second);
-        return h1 ^ (h2 << 1);
-    }
-};
-
 struct TileVariant {
     enum TextureSymmetry : uint8_t { SYMMETRIC, ROTATABLE };
 
     TileId tileId;
+    TileVariantId variant;
     std::string type;
     uint16_t textureId;
     TextureSymmetry symmetry;
 
     bool operator<(const TileVariant& other) const {
         if (tileId != other.tileId) return tileId < other.tileId;
-        if (type != other.type) return type < other.type;
+        if (variant != other.variant) return variant < other.variant;
         if (textureId != other.textureId) return textureId < other.textureId;
         return symmetry < other.symmetry;
     }
 };
 
+/**
+ * @brief Interns tile variant type names into compact TileVariantIds.
+ *
+ * Grid cells only store the id, the name is resolved through the table owned by the TileSet the
+ * tiles were generated from. Id 0 is reserved for TILE_VARIANT_NONE.
+ */
+class TileVariantTable {
+public:
+    TileVariantTable() { clear(); }
+
+    std::optional<TileVariantId> intern(const std::string& type) {
+        if (auto existing = find(type)) {
+            return existing;
+        }
+
+        if (types.size() > std::numeric_limits<TileVariantId>::max()) {
+            return std::nullopt;
+        }
+
+        auto variant = static_cast<TileVariantId>(types.size());
+        types.push_back(type);
+        variants[type] = variant;
+
+        return variant;
+    }
+
+    std::optional<TileVariantId> find(const std::string& type) const {
+        auto it = variants.find(type);
+
+        if (it == variants.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    const std::string& getType(TileVariantId variant) const {
+        if (variant >= types.size()) {
+            return types[TILE_VARIANT_NONE];
+        }
+
+        return types[variant];
+    }
+
+    std::size_t size() const { return types.size(); }
+
+    void clear() {
+        types.clear();
+        variants.clear();
+        types.push_back("");
+    }
+
+private:
+    std::vector<std::string> types;  // Indexed by TileVariantId
+    std::unordered_map<std::string, TileVariantId> variants;
+};
+
 }  // namespace SpaceRogueLite
@@ -1,51 +1,211 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
 #include <cstdint>
+#include <limits>
 #include <random>
+#include <span>
+#include <vector>
 
 namespace SpaceRogueLite::Utils {
 
-inline std::mt19937& getRandomGenerator() {
-    static std::random_device dev;
-    static std::mt19937 rng(dev());
-    return rng;
+/**
+ * @brief xoshiro256** generator, small and fast, and usable with the standard distributions.
+ *
+ * A stream split from a generator is seeded from that generator's seed and the stream id alone,
+ * not from how much has been drawn from it. Work divided across threads draws the same numbers
+ * whichever thread runs it and however far along the others are.
+ */
+class RandomGenerator {
+public:
+    using result_type = uint64_t;
+
+    explicit RandomGenerator(uint64_t seed = 0) : seed(seed) {
+        uint64_t mixed = seed;
+
+        for (auto& word : state) {
+            mixed += GOLDEN_GAMMA;
+            word = mix(mixed);
+        }
+    }
+
+    static constexpr result_type min(void) { return 0; }
+    static constexpr result_type max(void) { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()(void) {
+        uint64_t result = std::rotl(state[1] * 5, 7) * 9;
+        uint64_t shifted = state[1] << 17;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= shifted;
+        state[3] = std::rotl(state[3], 45);
+
+        return result;
+    }
+
+    // An independent generator for stream, splits can be chained for nested work
+    RandomGenerator split(uint64_t stream) const {
+        return RandomGenerator(mix(seed ^ mix(stream + GOLDEN_GAMMA)));
+    }
+
+    void fill(std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = (*this)();
+        }
+    }
+
+    uint64_t getSeed(void) const { return seed; }
+
+private:
+    static constexpr uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15;
+
+    // SplitMix64's finaliser
+    static uint64_t mix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t seed;
+    std::array<uint64_t, 4> state;
+};
+
+namespace Detail {
+
+struct RandomSeedState {
+    std::atomic<uint64_t> seed{std::random_device()()};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint64_t> nextStream{0};
+};
+
+inline RandomSeedState& getRandomSeedState(void) {
+    static RandomSeedState state;
+    return state;
 }
 
-inline void setRandomGeneratorSeed(uint32_t seed) { getRandomGenerator() = std::mt19937(seed); }
+}  // namespace Detail
+
+// Each thread has its own stream of the master seed, so threads never share a generator. Streams
+// are numbered by first use, the first thread to draw (normally the main thread) getting stream 0
+inline RandomGenerator& getRandomGenerator(void) {
+    struct ThreadGenerator {
+        RandomGenerator generator;
+        uint64_t stream;
+        uint32_t generation;
+    };
+
+    auto& seedState = Detail::getRandomSeedState();
+    thread_local ThreadGenerator threadGenerator = {
+        RandomGenerator(), seedState.nextStream++, std::numeric_limits<uint32_t>::max()};
+
+    uint32_t generation = seedState.generation.load();
+    if (threadGenerator.generation != generation) {
+        threadGenerator.generator =
+            RandomGenerator(seedState.seed.load()).split(threadGenerator.stream);
+        threadGenerator.generation = generation;
+    }
+
+    return threadGenerator.generator;
+}
+
+// Every thread's generator starts over from the new master seed the next time it's used
+inline void setRandomGeneratorSeed(uint64_t seed) {
+    auto& seedState = Detail::getRandomSeedState();
+
+    seedState.seed = seed;
+    seedState.generation++;
+}
+
+// Unbiased (Lemire's multiply and shift), and unlike the std distributions the same numbers on
+// every platform
+inline uint32_t randomRange(RandomGenerator& generator, uint32_t lower, uint32_t upper) {
+    uint64_t range = static_cast<uint64_t>(upper) - lower + 1;
+    uint64_t product = (generator() >> 32) * range;
+
+    if ((product & UINT32_MAX) < range) {
+        uint64_t threshold = ((uint64_t(1) << 32) - range) % range;
+
+        while ((product & UINT32_MAX) < threshold) {
+            product = (generator() >> 32) * range;
+        }
+    }
+
+    return lower + static_cast<uint32_t>(product >> 32);
+}
 
 inline uint32_t randomRange(uint32_t lower, uint32_t upper) {
-    std::uniform_int_distribution<std::mt19937::result_type> dist(lower, upper);
+    return randomRange(getRandomGenerator(), lower, upper);
+}
 
-    return dist(getRandomGenerator());
+inline double randomRangeDouble(RandomGenerator& generator, double lower, double upper) {
+    return lower + (generator() >> 11) * 0x1.0p-53 * (upper - lower);
 }
 
 inline double randomRangeDouble(double lower, double upper) {
-    std::uniform_real_distribution<> dist(lower, upper);
-
-    return dist(getRandomGenerator());
+    return randomRangeDouble(getRandomGenerator(), lower, upper);
 }
 
-inline uint32_t randomDN(uint32_t n) {
-    std::uniform_int_distribution<std::mt19937::result_type> distn(1, n);
+// Batches, for callers drawing a lot at once
+inline void fillRandomRange(RandomGenerator& generator, std::span<uint32_t> values, uint32_t lower,
+                            uint32_t upper) {
+    for (auto& value : values) {
+        value = randomRange(generator, lower, upper);
+    }
+}
 
-    return distn(getRandomGenerator());
+inline void fillRandomRangeDouble(RandomGenerator& generator, std::span<double> values,
+                                  double lower, double upper) {
+    for (auto& value : values) {
+        value = randomRangeDouble(generator, lower, upper);
+    }
 }
 
+inline uint32_t randomDN(uint32_t n) { return randomRange(1, n); }
+
 inline uint32_t randomD6(void) { return randomDN(6); }
 
+template <typename T>
+inline T randomChoice(RandomGenerator& generator, const std::vector<T>& vec) {
+    return vec[randomRange(generator, 0, vec.size() - 1)];
+}
+
 template <typename T>
 inline T randomChoice(const std::vector<T>& vec) {
-    return vec[randomRange(0, vec.size() - 1)];
+    return randomChoice(getRandomGenerator(), vec);
 }
 
 template <typename T>
-inline T randomChoice(const std::vector<T>& vec, const std::vector<int>& weights) {
-    game_assert(vec.size() == weights.size());
+inline T randomChoice(RandomGenerator& generator, const std::vector<T>& vec,
+                      const std::vector<int>& weights) {
+    assert(vec.size() == weights.size());
+
+    uint32_t totalWeight = 0;
+    for (int weight : weights) {
+        totalWeight += weight;
+    }
 
-    static std::default_random_engine generator;
-    std::discrete_distribution<int> dist(weights.begin(), weights.end());
+    uint32_t remaining = randomRange(generator, 0, totalWeight - 1);
 
-    return vec[dist(generator)];
+    for (size_t i = 0; i < vec.size(); i++) {
+        if (remaining < static_cast<uint32_t>(weights[i])) {
+            return vec[i];
+        }
+
+        remaining -= weights[i];
+    }
+
+    return vec.back();
+}
+
+template <typename T>
+inline T randomChoice(const std::vector<T>& vec, const std::vector<int>& weights) {
+    return randomChoice(getRandomGenerator(), vec, weights);
 }
 
 }  // namespace SpaceRogueLite::Utils
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace SpaceRogueLite::Utils {
+
+/**
+ * @brief Fixed size worker pool for splitting CPU heavy work (generation, queries) across cores.
+ *
+ * Threads blocked waiting on pool work help drain the queue, so parallelFor can safely be nested
+ * inside tasks that are themselves running on the pool.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned numThreads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& task) {
+        using Result = std::invoke_result_t<F>;
+
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        auto future = packagedTask->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packagedTask]() { (*packagedTask)(); });
+        }
+        condition.notify_one();
+
+        return future;
+    }
+
+    // Splits [0, count) into contiguous ranges of at least minRangeSize and blocks until every
+    // range has been run. The calling thread runs a share of the ranges itself
+    void parallelFor(size_t count, size_t minRangeSize,
+                     const std::function<void(size_t begin, size_t end)>& body);
+
+    // Waits on a future returned by submit, running queued tasks in the meantime
+    template <typename T>
+    T wait(std::future<T>& future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runPendingTask()) {
+                future.wait_for(std::chrono::microseconds(100));
+            }
+        }
+
+        return future.get();
+    }
+
+    unsigned getThreadCount(void) const;
+
+private:
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void workerLoop(void);
+    bool runPendingTask(void);
+};
+
+inline ThreadPool& getThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+}  // namespace SpaceRogueLite::Utils
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <grid.h>
+#include <walkabilitybitmap.h>
+
+#include <cstdint>
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Tiles visible from an origin, as a (2 * radius + 1)^2 bitset centred on the origin.
+ */
+struct VisibilitySet {
+    glm::ivec2 origin{0, 0};
+    int radius = 0;
+    std::vector<uint64_t> bits;
+
+    int getSide(void) const { return 2 * radius + 1; }
+
+    bool contains(const glm::ivec2& position) const {
+        glm::ivec2 local = position - origin + radius;
+
+        if (local.x < 0 || local.y < 0 || local.x >= getSide() || local.y >= getSide()) {
+            return false;
+        }
+
+        size_t index = local.y * getSide() + local.x;
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+
+    void set(const glm::ivec2& position) {
+        glm::ivec2 local = position - origin + radius;
+        size_t index = local.y * getSide() + local.x;
+        bits[index / 64] |= uint64_t(1) << (index % 64);
+    }
+
+    void reset(const glm::ivec2& newOrigin, int newRadius) {
+        origin = newOrigin;
+        radius = newRadius;
+        bits.assign((getSide() * getSide() + 63) / 64, 0);
+    }
+};
+
+/**
+ * @brief Per entity field of view using symmetric recursive shadowcasting over grid walkability.
+ *
+ * Blocked tiles are opaque. Results are cached per viewer and only recomputed on update() when
+ * the viewer has moved or changed radius, or when a grid chunk within its radius was dirtied.
+ */
+class FieldOfView {
+public:
+    explicit FieldOfView(Grid& grid);
+    ~FieldOfView();
+
+    FieldOfView(const FieldOfView&) = delete;
+    FieldOfView& operator=(const FieldOfView&) = delete;
+
+    void setViewer(entt::entity entity, const glm::ivec2& origin, int radius);
+    void removeViewer(entt::entity entity);
+    bool hasViewer(entt::entity entity) const;
+
+    void update(void);
+
+    // Returns nullptr if the entity isn't a viewer. Only valid until the next update()
+    const VisibilitySet* getVisibleTiles(entt::entity entity) const;
+    bool isVisible(entt::entity entity, const glm::ivec2& position) const;
+
+    size_t getLastRecomputeCount(void) const;
+
+private:
+    static constexpr size_t PARALLEL_VIEWER_COUNT = 16;
+
+    struct Viewer {
+        glm::ivec2 origin;
+        int radius;
+        bool isDirty = true;
+        VisibilitySet visible;
+    };
+
+    Grid& grid;
+    Grid::DirtyConsumerId dirtyConsumer;
+    const WalkabilityBitmap& walkability;  // Owned by the grid
+
+    std::unordered_map<entt::entity, Viewer> viewers;
+    size_t lastRecomputeCount = 0;
+
+    void markDirtyViewers(void);
+    void compute(Viewer& viewer) const;
+};
+
+}  // namespace SpaceRogueLite
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <grid.h>
+#include <walkabilitybitmap.h>
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+struct LineOfSightQuery {
+    glm::ivec2 from;
+    glm::ivec2 to;
+
+    bool operator==(const LineOfSightQuery& other) const = default;
+};
+
+/**
+ * @brief Batched tile to tile line of sight checks over the grid's walkability.
+ *
+ * A line of sight exists if every tile the segment between the two tile centres passes through
+ * (see TraversalMode::THIN) is walkable, the end tiles themselves are not tested. Rays are traced
+ * in packets of PACKET_SIZE against a packed walkability bitmap, large batches are split across
+ * the shared thread pool.
+ *
+ * Results are cached, bucketed by the chunk pair of their end points. Buckets are dropped when a
+ * chunk inside their bounds is dirtied in the grid, so static geometry isn't retested every tick.
+ */
+class LineOfSight {
+public:
+    static constexpr size_t PACKET_SIZE = 8;
+
+    explicit LineOfSight(Grid& grid);
+    ~LineOfSight();
+
+    LineOfSight(const LineOfSight&) = delete;
+    LineOfSight& operator=(const LineOfSight&) = delete;
+
+    // Drops cached results affected by grid changes. Called automatically by the queries
+    void update(void);
+
+    bool hasLineOfSight(const glm::ivec2& from, const glm::ivec2& to);
+
+    // Bit i of the result (word i / 64, bit i % 64) is set if queries[i] has line of sight
+    std::vector<uint64_t> query(const std::vector<LineOfSightQuery>& queries);
+
+    void setCachingEnabled(bool enabled);
+    void clearCache(void);
+    size_t getCachedResultCount(void) const;
+
+    const WalkabilityBitmap& getWalkability(void) const;
+
+private:
+    static constexpr size_t PARALLEL_BATCH_SIZE = 512;
+    static constexpr size_t MAX_CACHED_RESULTS = 1 << 20;
+
+    // Full width coordinates, so negative and far apart queries never share an entry
+    struct QueryHash {
+        size_t operator()(const LineOfSightQuery& query) const;
+    };
+
+    struct CacheBucket {
+        glm::ivec2 minChunk;
+        glm::ivec2 maxChunk;
+        std::unordered_map<LineOfSightQuery, bool, QueryHash> results;
+    };
+
+    Grid& grid;
+    Grid::DirtyConsumerId dirtyConsumer;
+    const WalkabilityBitmap& walkability;  // Owned by the grid
+
+    bool cachingEnabled = true;
+    size_t cachedResultCount = 0;
+    std::unordered_map<LineOfSightQuery, CacheBucket, QueryHash> cache;  // Keyed by getBucketKey
+
+    void traceQueries(const LineOfSightQuery* queries, size_t count, uint8_t* results) const;
+    void tracePacket(const LineOfSightQuery* queries, size_t count, uint8_t* results) const;
+
+    void invalidateChunks(const std::vector<glm::ivec2>& dirtyChunks);
+
+    static LineOfSightQuery getCanonicalQuery(const LineOfSightQuery& query);
+    static LineOfSightQuery getBucketKey(const LineOfSightQuery& query);
+};
+
+}  // namespace SpaceRogueLite
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief 1 bit per tile walkability mask, row-major with each row padded to whole 64 bit words.
+ *
+ * Positions outside of the bitmap are reported as blocked.
+ */
+class WalkabilityBitmap {
+public:
+    WalkabilityBitmap() = default;
+    WalkabilityBitmap(int width, int height);
+
+    void resize(int newWidth, int newHeight);
+
+    void setWalkable(int x, int y, bool walkable) {
+        if (!isValidPosition(x, y)) {
+            return;
+        }
+
+        uint64_t mask = uint64_t(1) << (x & 63);
+        auto& word = words[y * wordsPerRow + (x >> 6)];
+        word = walkable ? (word | mask) : (word & ~mask);
+    }
+
+    bool isWalkable(int x, int y) const {
+        return isValidPosition(x, y) &&
+               ((words[y * wordsPerRow + (x >> 6)] >> (x & 63)) & uint64_t(1)) != 0;
+    }
+
+    int getWidth(void) const { return width; }
+    int getHeight(void) const { return height; }
+    int getWordsPerRow(void) const { return wordsPerRow; }
+    const std::vector<uint64_t>& getWords(void) const { return words; }
+
+private:
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    std::vector<uint64_t> words;
+
+    bool isValidPosition(int x, int y) const {
+        return x >= 0 && x < width && y >= 0 && y < height;
+    }
+};
+
+}  // namespace SpaceRogueLite
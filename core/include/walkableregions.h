@@ -0,0 +1,66 @@
+#pragma once
+
+#include <walkabilitybitmap.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Labels 4-connected regions of walkable tiles.
+ *
+ * 4-connected regions match reachability for 8-directional movement that can't cut corners, since
+ * a diagonal step is only allowed when both orthogonal tiles are walkable.
+ *
+ * Single tile changes are applied straight away and only touch the regions around the tile. A
+ * tile becoming walkable joins its neighbours' regions, the smaller ones being relabelled into the
+ * largest. A tile becoming blocked can only split its region if its neighbours aren't joined
+ * through the tiles around it, in which case searches run from each side at once and the pieces
+ * that run out of tiles first (the smaller ones) are given new labels. Bulk changes relabel
+ * everything on the next update(). Region ids are only stable until the next change.
+ */
+class WalkableRegions {
+public:
+    static constexpr int32_t NO_REGION = -1;
+
+    // Relabels everything on the next update(), for bulk changes
+    void invalidate(void);
+
+    // Call after the tile's bit has been changed in the bitmap
+    void onWalkabilityChanged(const WalkabilityBitmap& walkability, int x, int y);
+
+    void update(const WalkabilityBitmap& walkability);
+    bool isUpToDate(void) const;
+
+    // Only valid once updated. NO_REGION for blocked tiles and positions outside the bitmap
+    int32_t getRegion(int x, int y) const;
+    size_t getRegionCount(void) const;
+
+private:
+    int width = 0;
+    int height = 0;
+    bool needsRelabel = true;
+    size_t regionCount = 0;
+
+    std::vector<int32_t> labels;        // Region id by tile index, NO_REGION for blocked tiles
+    std::vector<int32_t> regionSizes;   // Tiles by region id, 0 for unused ids
+    std::vector<int32_t> freeRegionIds;
+
+    void relabel(const WalkabilityBitmap& walkability);
+    void onTileWalkable(const WalkabilityBitmap& walkability, int32_t tile);
+    void onTileBlocked(const WalkabilityBitmap& walkability, int32_t tile, int32_t region);
+
+    int32_t createRegion(void);
+    void releaseRegion(int32_t region);
+
+    // Walkable 4-neighbours of tile, returns how many were written to neighbours
+    int getWalkableNeighbours(const WalkabilityBitmap& walkability, int32_t tile,
+                              int32_t neighbours[4]) const;
+
+    // True if the walkable neighbours of tile are joined through its 8 surrounding tiles alone
+    bool areNeighboursJoinedLocally(const WalkabilityBitmap& walkability, int32_t tile) const;
+};
+
+}  // namespace SpaceRogueLite
@@ -8,13 +8,24 @@ GenerationStrategy::GenerationStrategy(const RoomConfiguration& roomConfiguratio
 
     width = grid.getWidth();
     height = grid.getHeight();
+}
 
-    data.resize(width * height, TILE_DEFAULT);
+void GenerationStrategy::setProgressCallback(ProgressCallback callback) {
+    progressCallback = std::move(callback);
 }
 
-void GenerationStrategy::setTile(int x, int y, const GridTile& tile) { data[y * width + x] = tile; }
+void GenerationStrategy::requestStop(void) { stopSource.request_stop(); }
+
+bool GenerationStrategy::isStopRequested(void) const { return stopSource.stop_requested(); }
+
+std::stop_token GenerationStrategy::getStopToken(void) const { return stopSource.get_token(); }
 
-GridTile GenerationStrategy::getTile(int x, int y) const { return data[y * width + x]; }
+void GenerationStrategy::reportProgress(const GridRegion& region,
+                                        const std::vector<GridTile>& tiles) const {
+    if (progressCallback) {
+        progressCallback(region, tiles);
+    }
+}
 
 int GenerationStrategy::getWidth(void) const { return width; }
 
@@ -26,7 +37,8 @@ GenerationStrategy::RoomConfiguration GenerationStrategy::getRoomConfiguration(v
 
 void GenerationStrategy::addRoom(const Room& room) { rooms.push_back(room); }
 
-bool GenerationStrategy::hasCollision(const Room& room, const std::vector<Room>& existingRooms) {
+bool GenerationStrategy::hasCollision(const Room& room,
+                                      const std::vector<Room>& existingRooms) const {
     for (auto existingRoom : existingRooms) {
         if (hasCollision(existingRoom, room)) {
             return true;
@@ -36,12 +48,12 @@ bool GenerationStrategy::hasCollision(const Room& room, const std::vector<Room>&
     return false;
 }
 
-bool GenerationStrategy::hasCollision(const Room& roomA, const Room& roomB) {
+bool GenerationStrategy::hasCollision(const Room& roomA, const Room& roomB) const {
     return roomA.min.x < roomB.max.x && roomA.max.x > roomB.min.x && roomA.min.y < roomB.max.y &&
            roomA.max.y > roomB.min.y;
 }
 
-bool GenerationStrategy::isSparse(const Room& room, const std::vector<Room>& existingRooms) {
+bool GenerationStrategy::isSparse(const Room& room, const std::vector<Room>& existingRooms) const {
     int sparseness = getRoomConfiguration().sparseness;
 
     if (sparseness <= 0) {
@@ -51,7 +63,8 @@ bool GenerationStrategy::isSparse(const Room& room, const std::vector<Room>& exi
     return shortestDistance(room, existingRooms) >= sparseness;
 }
 
-int GenerationStrategy::shortestDistance(const Room& room, const std::vector<Room>& existingRooms) {
+int GenerationStrategy::shortestDistance(const Room& room,
+                                         const std::vector<Room>& existingRooms) const {
     int shortestDistance = std::numeric_limits<int>::max();
 
     for (auto existingRoom : existingRooms) {
@@ -65,9 +78,9 @@ int GenerationStrategy::shortestDistance(const Room& room, const std::vector<Roo
     return shortestDistance;
 }
 
-int GenerationStrategy::distance(const Room& roomA, const Room& roomB) {
-    auto roomACenter = glm::vec2(roomA.max.x - roomA.min.x, roomA.max.y - roomA.min.y);
-    auto roomBCenter = glm::vec2(roomB.max.x - roomB.min.x, roomB.max.y - roomB.min.y);
+int GenerationStrategy::distance(const Room& roomA, const Room& roomB) const {
+    auto roomACenter = glm::vec2(roomA.min + roomA.max) * 0.5f;
+    auto roomBCenter = glm::vec2(roomB.min + roomB.max) * 0.5f;
 
     return static_cast<int>(glm::distance(roomACenter, roomBCenter));
 }
@@ -76,6 +89,4 @@ const std::vector<GenerationStrategy::Room>& GenerationStrategy::getRooms(void)
     return rooms;
 }
 
-void GenerationStrategy::clearRooms(void) { rooms.clear(); }
-
-const std::vector<GridTile>& GenerationStrategy::getData(void) const { return data; }
\ No newline at end of file
+void GenerationStrategy::clearRooms(void) { rooms.clear(); }
\ No newline at end of file
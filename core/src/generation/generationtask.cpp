@@ -0,0 +1,120 @@
+#include "generation/generationtask.h"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <utility>
+
+#include "utils/threadpool.h"
+
+using namespace SpaceRogueLite;
+
+GenerationTask::GenerationTask(std::unique_ptr<GenerationStrategy> strategy)
+    : strategy(std::move(strategy)) {
+    this->strategy->setProgressCallback(
+        [this](const GridRegion& region, const std::vector<GridTile>& tiles) {
+            onProgress(region, tiles);
+        });
+
+    result = Utils::getThreadPool().submit([this]() { return this->strategy->generate(); });
+}
+
+GenerationTask::~GenerationTask() {
+    cancel();
+    wait();
+}
+
+bool GenerationTask::publishTo(Grid& grid) {
+    if (published || cancelled) {
+        return true;
+    }
+
+    const int width = strategy->getWidth();
+    const int height = strategy->getHeight();
+
+    // Someone else has put a different map in the grid since generation started
+    if (grid.getWidth() != width || grid.getHeight() != height) {
+        spdlog::warn("Grid is now {}x{}, dropping the generated {}x{} map", grid.getWidth(),
+                     grid.getHeight(), width, height);
+        cancel();
+        return true;
+    }
+
+    std::vector<FinishedRegion> regions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        regions.swap(finishedRegions);
+    }
+
+    for (const auto& finished : regions) {
+        grid.setRegion(finished.region, finished.tiles);
+    }
+
+    if (!isFinished()) {
+        return false;
+    }
+
+    // Anything reported from an attempt that was later thrown away is replaced here, which only
+    // dirties the chunks that differ
+    auto tiles = result.get();
+    published = true;
+
+    // A failed generation leaves whatever was streamed in place
+    if (tiles.empty()) {
+        return true;
+    }
+
+    grid.setRegion({0, 0, width, height}, tiles);
+
+    spdlog::info("Published generated {}x{} map", width, height);
+
+    return true;
+}
+
+void GenerationTask::cancel(void) {
+    if (cancelled.exchange(true)) {
+        return;
+    }
+
+    strategy->requestStop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finishedRegions.clear();
+}
+
+bool GenerationTask::isCancelled(void) const { return cancelled; }
+
+bool GenerationTask::isFinished(void) const {
+    return !result.valid() ||
+           result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+bool GenerationTask::isPublished(void) const { return published; }
+
+void GenerationTask::wait(void) {
+    if (result.valid()) {
+        result.wait();
+    }
+}
+
+const GenerationStrategy& GenerationTask::getStrategy(void) const { return *strategy; }
+
+void GenerationTask::onProgress(const GridRegion& region, const std::vector<GridTile>& tiles) {
+    if (cancelled) {
+        return;
+    }
+
+    FinishedRegion finished = {region, {}};
+    finished.tiles.reserve(static_cast<size_t>(region.width) * region.height);
+
+    for (int y = region.y; y < region.y + region.height; y++) {
+        auto row = tiles.begin() + static_cast<size_t>(y) * strategy->getWidth() + region.x;
+        finished.tiles.insert(finished.tiles.end(), row, row + region.width);
+    }
+
+    // Checked again under the lock, cancel may have cleared the queue while this was copying
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!cancelled) {
+        finishedRegions.push_back(std::move(finished));
+    }
+}
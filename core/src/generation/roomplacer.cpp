@@ -0,0 +1,162 @@
+#include "generation/roomplacer.h"
+
+#include <algorithm>
+#include <numbers>
+
+using namespace SpaceRogueLite;
+
+RoomPlacer::RoomPlacer(const GenerationStrategy& strategy) : strategy(strategy) {
+    auto configuration = strategy.getRoomConfiguration();
+    int maxExtent = std::max(configuration.maxRoomSize.x, configuration.maxRoomSize.y);
+
+    spacing = std::max(configuration.sparseness, maxExtent + 1);
+    bucketSize = std::max(maxExtent + 1, 1);
+
+    glm::ivec2 mapSize(strategy.getWidth(), strategy.getHeight());
+    bucketCount = glm::max((mapSize + bucketSize - 1) / bucketSize, glm::ivec2(1));
+    buckets.resize(bucketCount.x * bucketCount.y);
+}
+
+std::optional<GenerationStrategy::Room> RoomPlacer::place(Utils::RandomGenerator& rng) {
+    if (isFull) {
+        return std::nullopt;
+    }
+
+    auto configuration = strategy.getRoomConfiguration();
+    auto room = placeSized(rng, configuration.minRoomSize, configuration.maxRoomSize, false);
+
+    // Anything which doesn't fit at the smallest size won't fit at all, so rooms with no space
+    // around them at that size are retired
+    if (!room.has_value()) {
+        room = placeSized(rng, configuration.minRoomSize, configuration.minRoomSize, true);
+    }
+
+    isFull = !room.has_value();
+    return room;
+}
+
+const std::vector<GenerationStrategy::Room>& RoomPlacer::getRooms(void) const { return rooms; }
+
+std::optional<GenerationStrategy::Room> RoomPlacer::placeSized(Utils::RandomGenerator& rng,
+                                                               const glm::ivec2& minSize,
+                                                               const glm::ivec2& maxSize,
+                                                               bool canRetire) {
+    for (int attempt = 0; attempt < UNIFORM_ATTEMPTS; attempt++) {
+        auto room = createUniformRoom(rng, createRoomSize(rng, minSize, maxSize));
+
+        if (room.has_value() && canPlace(*room)) {
+            add(*room);
+            return room;
+        }
+    }
+
+    int attempts = 0;
+
+    while (!activeRooms.empty() && attempts < MAX_POISSON_ATTEMPTS) {
+        size_t active = Utils::randomRange(rng, 0, activeRooms.size() - 1);
+        auto around = rooms[activeRooms[active]];
+
+        for (int candidate = 0; candidate < POISSON_CANDIDATES; candidate++, attempts++) {
+            auto room = createRoomAround(rng, around, createRoomSize(rng, minSize, maxSize));
+
+            if (room.has_value() && canPlace(*room)) {
+                add(*room);
+                return room;
+            }
+        }
+
+        if (canRetire) {
+            activeRooms[active] = activeRooms.back();
+            activeRooms.pop_back();
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<GenerationStrategy::Room> RoomPlacer::createUniformRoom(
+    Utils::RandomGenerator& rng, const glm::ivec2& size) const {
+    // Rooms stay clear of the map edge
+    glm::ivec2 maxPosition = glm::ivec2(strategy.getWidth(), strategy.getHeight()) - size - 2;
+
+    if (maxPosition.x < 1 || maxPosition.y < 1) {
+        return std::nullopt;
+    }
+
+    glm::ivec2 position(Utils::randomRange(rng, 1, maxPosition.x),
+                        Utils::randomRange(rng, 1, maxPosition.y));
+
+    return Room{position, position + size};
+}
+
+std::optional<GenerationStrategy::Room> RoomPlacer::createRoomAround(
+    Utils::RandomGenerator& rng, const Room& room, const glm::ivec2& size) const {
+    float angle = Utils::randomRangeDouble(rng, 0.0, 2.0 * std::numbers::pi);
+    float radius = Utils::randomRangeDouble(rng, spacing, 2.0 * spacing);
+
+    auto centre = glm::vec2(room.min + room.max) * 0.5f +
+                  radius * glm::vec2(std::cos(angle), std::sin(angle));
+    auto position = glm::ivec2(glm::round(centre - glm::vec2(size) * 0.5f));
+
+    Room candidate = {position, position + size};
+
+    if (!isInBounds(candidate)) {
+        return std::nullopt;
+    }
+
+    return candidate;
+}
+
+glm::ivec2 RoomPlacer::createRoomSize(Utils::RandomGenerator& rng, const glm::ivec2& minSize,
+                                      const glm::ivec2& maxSize) const {
+    return glm::ivec2(Utils::randomRange(rng, minSize.x, maxSize.x),
+                      Utils::randomRange(rng, minSize.y, maxSize.y));
+}
+
+bool RoomPlacer::isInBounds(const Room& room) const {
+    return room.min.x >= 1 && room.min.y >= 1 && room.max.x <= strategy.getWidth() - 2 &&
+           room.max.y <= strategy.getHeight() - 2;
+}
+
+bool RoomPlacer::canPlace(const Room& room) const {
+    int sparseness = strategy.getRoomConfiguration().sparseness;
+
+    // Colliding rooms overlap this one, rooms too close have their centre (and so a bucket)
+    // within sparseness of this one's centre
+    glm::ivec2 centre = (room.min + room.max) / 2;
+    glm::ivec2 queryMin = glm::min(room.min, centre - sparseness - 1);
+    glm::ivec2 queryMax = glm::max(room.max, centre + sparseness + 1);
+
+    glm::ivec2 bucketMin = glm::clamp(queryMin / bucketSize, glm::ivec2(0), bucketCount - 1);
+    glm::ivec2 bucketMax = glm::clamp(queryMax / bucketSize, glm::ivec2(0), bucketCount - 1);
+
+    for (int y = bucketMin.y; y <= bucketMax.y; y++) {
+        for (int x = bucketMin.x; x <= bucketMax.x; x++) {
+            for (size_t index : buckets[y * bucketCount.x + x]) {
+                const auto& other = rooms[index];
+
+                if (strategy.hasCollision(room, other) ||
+                    (sparseness > 0 && strategy.distance(room, other) < sparseness)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void RoomPlacer::add(const Room& room) {
+    size_t index = rooms.size();
+    rooms.push_back(room);
+    activeRooms.push_back(index);
+
+    glm::ivec2 bucketMin = glm::clamp(room.min / bucketSize, glm::ivec2(0), bucketCount - 1);
+    glm::ivec2 bucketMax = glm::clamp(room.max / bucketSize, glm::ivec2(0), bucketCount - 1);
+
+    for (int y = bucketMin.y; y <= bucketMax.y; y++) {
+        for (int x = bucketMin.x; x <= bucketMax.x; x++) {
+            buckets[y * bucketCount.x + x].push_back(index);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include "generation/wfc/compiledtileset.h"
+
+using namespace SpaceRogueLite;
+
+CompiledTileSet::CompiledTileSet(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                                 const std::vector<Neighbour>& neighbours) {
+    buildPatterns(tiles);
+    buildPropagator(tiles, neighbours);
+}
+
+CompiledTileSet::CompiledTileSet(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                                 std::vector<double> weights,
+                                 Propagator::PropagatorState propagator) {
+    buildPatterns(tiles);
+
+    this->weights = std::move(weights);
+    this->propagator = std::move(propagator);
+}
+
+std::optional<unsigned> CompiledTileSet::getPattern(unsigned tile, unsigned orientation) const {
+    if (tile >= patternIds.size() || orientation >= patternIds[tile].size()) {
+        return std::nullopt;
+    }
+
+    return patternIds[tile][orientation];
+}
+
+const WFCTileSet::WFCTile& CompiledTileSet::getPatternTile(unsigned pattern) const {
+    return patternTiles[pattern];
+}
+
+size_t CompiledTileSet::getPatternCount(void) const { return patternTiles.size(); }
+
+const std::vector<double>& CompiledTileSet::getWeights(void) const { return weights; }
+
+const Propagator::PropagatorState& CompiledTileSet::getPropagator(void) const { return propagator; }
+
+// Patterns are numbered the same way TilingWFC numbers its oriented tiles, so a seed gives the
+// same map either way
+void CompiledTileSet::buildPatterns(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles) {
+    patternTiles.clear();
+    patternIds.assign(tiles.size(), {});
+    weights.clear();
+
+    for (unsigned tile = 0; tile < tiles.size(); tile++) {
+        for (const auto& orientation : tiles[tile].data) {
+            patternIds[tile].push_back(static_cast<unsigned>(patternTiles.size()));
+            patternTiles.push_back(orientation.data[0]);
+            weights.push_back(tiles[tile].weight / tiles[tile].data.size());
+        }
+    }
+}
+
+void CompiledTileSet::buildPropagator(const std::vector<Tile<WFCTileSet::WFCTile>>& tiles,
+                                      const std::vector<Neighbour>& neighbours) {
+    const size_t patternCount = patternTiles.size();
+
+    // [pattern][direction][other pattern], directions are up, left, right, down
+    std::vector<std::array<std::vector<bool>, 4>> isAllowed(patternCount);
+    for (auto& directions : isAllowed) {
+        directions.fill(std::vector<bool>(patternCount, false));
+    }
+
+    for (const auto& [tile1, orientation1, tile2, orientation2] : neighbours) {
+        auto actions1 = Tile<WFCTileSet::WFCTile>::generate_action_map(tiles[tile1].symmetry);
+        auto actions2 = Tile<WFCTileSet::WFCTile>::generate_action_map(tiles[tile2].symmetry);
+
+        // A rule says tile2 may sit to the right of tile1, every rotation and reflection of the
+        // pair holds too
+        auto allow = [&](unsigned action, unsigned direction) {
+            unsigned pattern1 = patternIds[tile1][actions1[action][orientation1]];
+            unsigned pattern2 = patternIds[tile2][actions2[action][orientation2]];
+
+            isAllowed[pattern1][direction][pattern2] = true;
+            isAllowed[pattern2][3 - direction][pattern1] = true;
+        };
+
+        allow(0, 2);
+        allow(1, 0);
+        allow(2, 1);
+        allow(3, 3);
+        allow(4, 1);
+        allow(5, 3);
+        allow(6, 2);
+        allow(7, 0);
+    }
+
+    propagator.assign(patternCount, {});
+
+    for (size_t pattern = 0; pattern < patternCount; pattern++) {
+        for (size_t other = 0; other < patternCount; other++) {
+            for (size_t direction = 0; direction < 4; direction++) {
+                if (isAllowed[pattern][direction][other]) {
+                    propagator[pattern][direction].push_back(static_cast<unsigned>(other));
+                }
+            }
+        }
+    }
+}
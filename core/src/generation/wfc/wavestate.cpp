@@ -0,0 +1,449 @@
+#include "generation/wfc/wavestate.h"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/randomutils.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+// Up, left, right, down, matching the propagator's directions
+constexpr int DIRECTION_X[4] = {0, -1, 1, 0};
+constexpr int DIRECTION_Y[4] = {-1, 0, 0, 1};
+
+}  // namespace
+
+WaveState::WaveState(const CompiledTileSet& rules, int width, int height)
+    : rules(&rules),
+      width(width),
+      height(height),
+      patternCount(static_cast<unsigned>(rules.getPatternCount())),
+      wordCount(std::max((patternCount + WORD_BITS - 1) / WORD_BITS, 1u)) {
+    const auto& weights = rules.getWeights();
+    const auto& propagator = rules.getPropagator();
+    const size_t cellCount = static_cast<size_t>(width) * height;
+
+    double weightSum = 0.0;
+    double weightLogWeightSum = 0.0;
+    minHalfWeightLogWeight = std::numeric_limits<double>::infinity();
+
+    for (double weight : weights) {
+        double weightLogWeight = weight * std::log(weight);
+
+        weightLogWeights.push_back(weightLogWeight);
+        weightSum += weight;
+        weightLogWeightSum += weightLogWeight;
+    }
+
+    // Entropies don't depend on the scale of the weights but the noise bound does, so it's taken
+    // from the normalised weights as fast-wfc does
+    for (double weight : weights) {
+        double frequency = weight / weightSum;
+        minHalfWeightLogWeight =
+            std::min(minHalfWeightLogWeight, std::abs(frequency * std::log(frequency) / 2));
+    }
+
+    std::vector<Word> allPatterns(wordCount, 0);
+    for (unsigned pattern = 0; pattern < patternCount; pattern++) {
+        allPatterns[pattern / WORD_BITS] |= Word(1) << (pattern % WORD_BITS);
+    }
+
+    domains.resize(cellCount * wordCount);
+    for (size_t cell = 0; cell < cellCount; cell++) {
+        std::copy(allPatterns.begin(), allPatterns.end(), domains.begin() + cell * wordCount);
+    }
+
+    supportMasks.assign(static_cast<size_t>(patternCount) * 4 * wordCount, 0);
+    for (unsigned pattern = 0; pattern < patternCount; pattern++) {
+        for (int direction = 0; direction < 4; direction++) {
+            Word* mask = &supportMasks[(pattern * 4 + direction) * wordCount];
+
+            for (unsigned allowed : propagator[pattern][direction]) {
+                mask[allowed / WORD_BITS] |= Word(1) << (allowed % WORD_BITS);
+            }
+        }
+    }
+
+    allowedMask.resize(wordCount);
+    isPending.assign(cellCount, false);
+
+    possibleCounts.assign(cellCount, patternCount);
+    weightSums.assign(cellCount, weightSum);
+    weightLogWeightSums.assign(cellCount, weightLogWeightSum);
+    entropies.assign(cellCount, std::log(weightSum) - weightLogWeightSum / weightSum);
+}
+
+int WaveState::getWidth(void) const { return width; }
+
+int WaveState::getHeight(void) const { return height; }
+
+bool WaveState::setTile(int x, int y, unsigned tile, unsigned orientation) {
+    auto chosen = rules->getPattern(tile, orientation);
+    if (!chosen.has_value() || x < 0 || y < 0 || x >= width || y >= height) {
+        return false;
+    }
+
+    collapse(static_cast<size_t>(y) * width + x, *chosen);
+    return true;
+}
+
+bool WaveState::propagate(void) {
+    while (!pendingCells.empty() && !isContradicted) {
+        size_t cell = pendingCells.back();
+        pendingCells.pop_back();
+        isPending[cell] = false;
+
+        const Word* domain = getDomain(cell);
+        int x = static_cast<int>(cell % width);
+        int y = static_cast<int>(cell / width);
+
+        for (int direction = 0; direction < 4 && !isContradicted; direction++) {
+            int neighbourX = x + DIRECTION_X[direction];
+            int neighbourY = y + DIRECTION_Y[direction];
+
+            if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= height) {
+                continue;
+            }
+
+            // Everything any of this cell's patterns allows that way, a whole word at a time
+            std::fill(allowedMask.begin(), allowedMask.end(), 0);
+
+            for (unsigned word = 0; word < wordCount; word++) {
+                for (Word bits = domain[word]; bits != 0; bits &= bits - 1) {
+                    unsigned pattern = word * WORD_BITS + std::countr_zero(bits);
+                    const Word* mask = getSupportMask(pattern, direction);
+
+                    for (unsigned i = 0; i < wordCount; i++) {
+                        allowedMask[i] |= mask[i];
+                    }
+                }
+            }
+
+            restrict(static_cast<size_t>(neighbourY) * width + neighbourX, allowedMask.data());
+        }
+    }
+
+    return !isContradicted;
+}
+
+std::optional<Array2D<unsigned>> WaveState::solve(int seed, int backtrackLimit) {
+    const auto& weights = rules->getWeights();
+    Utils::RandomGenerator generator(seed);
+
+    isTrailing = backtrackLimit > 0;
+
+    if (!propagate()) {
+        return std::nullopt;
+    }
+
+    // Noise smaller than any pattern's contribution picks between cells of equal entropy. It's
+    // fixed per cell so heap entries stay comparable
+    noise.resize(possibleCounts.size());
+    Utils::fillRandomRangeDouble(generator, noise, 0.0, minHalfWeightLogWeight);
+
+    std::vector<HeapEntry> entries;
+    for (size_t cell = 0; cell < possibleCounts.size(); cell++) {
+        if (possibleCounts[cell] > 1) {
+            entries.emplace_back(entropies[cell] + noise[cell], cell);
+        }
+    }
+    entropyHeap = decltype(entropyHeap)(std::greater<HeapEntry>(), std::move(entries));
+
+    // Region resets go back to this, everything else is undone through the trail
+    std::vector<Word> initialDomains;
+    if (isTrailing) {
+        initialDomains = domains;
+    }
+
+    std::vector<Decision> decisions;
+    int backtracksSinceReset = 0;
+
+    for (int cell = findLowestEntropyCell(); cell >= 0; cell = findLowestEntropyCell()) {
+        double remaining = Utils::randomRangeDouble(generator, 0.0, weightSums[cell]);
+
+        const Word* domain = getDomain(cell);
+        unsigned chosen = patternCount;
+        bool isChosen = false;
+
+        // Checked after subtracting so a draw of 0 picks the first pattern. If rounding leaves
+        // some of the draw over, the last possible pattern is kept
+        for (unsigned word = 0; word < wordCount && !isChosen; word++) {
+            for (Word bits = domain[word]; bits != 0 && !isChosen; bits &= bits - 1) {
+                chosen = word * WORD_BITS + std::countr_zero(bits);
+                remaining -= weights[chosen];
+                isChosen = remaining < 0.0;
+            }
+        }
+
+        if (isTrailing) {
+            decisions.push_back({trail.size(), static_cast<size_t>(cell), chosen});
+        }
+
+        collapse(cell, chosen);
+
+        if (propagate()) {
+            continue;
+        }
+
+        if (!isTrailing ||
+            !recover(decisions, backtrackLimit, backtracksSinceReset, initialDomains)) {
+            return std::nullopt;
+        }
+    }
+
+    Array2D<unsigned> patterns(height, width);
+
+    for (size_t cell = 0; cell < patterns.data.size(); cell++) {
+        const Word* domain = getDomain(cell);
+
+        for (unsigned word = 0; word < wordCount; word++) {
+            if (domain[word] != 0) {
+                patterns.data[cell] = word * WORD_BITS + std::countr_zero(domain[word]);
+                break;
+            }
+        }
+    }
+
+    return patterns;
+}
+
+int WaveState::getBacktrackCount(void) const { return backtrackCount; }
+
+int WaveState::getRegionResetCount(void) const { return regionResetCount; }
+
+WaveState::Word* WaveState::getDomain(size_t cell) { return &domains[cell * wordCount]; }
+
+const WaveState::Word* WaveState::getSupportMask(unsigned pattern, int direction) const {
+    return &supportMasks[(pattern * 4 + direction) * wordCount];
+}
+
+void WaveState::restrict(size_t cell, const Word* allowed) {
+    Word* domain = getDomain(cell);
+
+    bool isChanged = false;
+    for (unsigned word = 0; word < wordCount; word++) {
+        isChanged |= (domain[word] & ~allowed[word]) != 0;
+    }
+
+    if (!isChanged) {
+        return;
+    }
+
+    if (isTrailing) {
+        trail.push_back({cell, weightSums[cell], weightLogWeightSums[cell]});
+        trailDomains.insert(trailDomains.end(), domain, domain + wordCount);
+    }
+
+    const auto& weights = rules->getWeights();
+
+    for (unsigned word = 0; word < wordCount; word++) {
+        Word removed = domain[word] & ~allowed[word];
+        domain[word] &= allowed[word];
+
+        for (; removed != 0; removed &= removed - 1) {
+            unsigned pattern = word * WORD_BITS + std::countr_zero(removed);
+
+            weightSums[cell] -= weights[pattern];
+            weightLogWeightSums[cell] -= weightLogWeights[pattern];
+        }
+    }
+
+    updateCell(cell);
+
+    if (possibleCounts[cell] == 0) {
+        isContradicted = true;
+        contradictionCell = cell;
+        return;
+    }
+
+    pushEntropy(cell);
+
+    if (!isPending[cell]) {
+        isPending[cell] = true;
+        pendingCells.push_back(cell);
+    }
+}
+
+void WaveState::ban(size_t cell, unsigned pattern) {
+    std::copy_n(getDomain(cell), wordCount, allowedMask.begin());
+    allowedMask[pattern / WORD_BITS] &= ~(Word(1) << (pattern % WORD_BITS));
+
+    restrict(cell, allowedMask.data());
+}
+
+void WaveState::collapse(size_t cell, unsigned pattern) {
+    std::fill(allowedMask.begin(), allowedMask.end(), 0);
+    allowedMask[pattern / WORD_BITS] = Word(1) << (pattern % WORD_BITS);
+
+    restrict(cell, allowedMask.data());
+}
+
+void WaveState::undo(size_t trailSize) {
+    while (trail.size() > trailSize) {
+        Change change = trail.back();
+        trail.pop_back();
+
+        std::copy(trailDomains.end() - wordCount, trailDomains.end(), getDomain(change.cell));
+        trailDomains.resize(trailDomains.size() - wordCount);
+
+        weightSums[change.cell] = change.weightSum;
+        weightLogWeightSums[change.cell] = change.weightLogWeightSum;
+        updateCell(change.cell);
+        pushEntropy(change.cell);
+    }
+
+    for (size_t cell : pendingCells) {
+        isPending[cell] = false;
+    }
+
+    pendingCells.clear();
+    isContradicted = false;
+}
+
+// Backtracks first, then resets a growing region around the contradiction. Backtracks start over
+// after each reset but resets are limited for the whole solve, so a solve always ends. False once
+// both are used up, the wave is left contradicted
+bool WaveState::recover(std::vector<Decision>& decisions, int backtrackLimit,
+                        int& backtracksSinceReset, const std::vector<Word>& initialDomains) {
+    while (backtracksSinceReset < backtrackLimit && !decisions.empty()) {
+        Decision decision = decisions.back();
+        decisions.pop_back();
+
+        undo(decision.trailSize);
+        backtrackCount++;
+        backtracksSinceReset++;
+
+        // The ban belongs to the decision before, so it's undone along with that one
+        ban(decision.cell, decision.pattern);
+
+        if (propagate()) {
+            return true;
+        }
+    }
+
+    // Resets widen around the same cell, so each one covers everything the last one touched
+    size_t centre = contradictionCell;
+    int radius = INITIAL_RESET_RADIUS;
+
+    // Back to the last state known to be consistent
+    undo(decisions.empty() ? 0 : decisions.back().trailSize);
+    decisions.clear();
+    backtracksSinceReset = 0;
+
+    for (; regionResetCount < MAX_REGION_RESETS; radius *= 2) {
+        regionResetCount++;
+
+        if (resetRegion(centre, radius, initialDomains)) {
+            return true;
+        }
+
+        undo(0);
+    }
+
+    spdlog::debug("WFC gave up after {} backtracks and {} region resets", backtrackCount,
+                  regionResetCount);
+    isContradicted = true;
+    return false;
+}
+
+// Gives every cell within radius of cell back the patterns it had when solving started. The new
+// state isn't on the trail, it replaces the start of it
+bool WaveState::resetRegion(size_t cell, int radius, const std::vector<Word>& initialDomains) {
+    int centreX = static_cast<int>(cell % width);
+    int centreY = static_cast<int>(cell / width);
+    int minX = std::max(centreX - radius, 0);
+    int minY = std::max(centreY - radius, 0);
+    int maxX = std::min(centreX + radius, width - 1);
+    int maxY = std::min(centreY + radius, height - 1);
+
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            size_t resetCell = static_cast<size_t>(y) * width + x;
+
+            std::copy_n(initialDomains.begin() + resetCell * wordCount, wordCount,
+                        getDomain(resetCell));
+            recountCell(resetCell);
+            pushEntropy(resetCell);
+        }
+    }
+
+    trail.clear();
+    trailDomains.clear();
+
+    // The region and the cells bordering it are revised against each other, anything left
+    // without support goes and that propagates as usual
+    for (int y = std::max(minY - 1, 0); y <= std::min(maxY + 1, height - 1); y++) {
+        for (int x = std::max(minX - 1, 0); x <= std::min(maxX + 1, width - 1); x++) {
+            size_t revisedCell = static_cast<size_t>(y) * width + x;
+
+            if (!isPending[revisedCell]) {
+                isPending[revisedCell] = true;
+                pendingCells.push_back(revisedCell);
+            }
+        }
+    }
+
+    if (!propagate()) {
+        return false;
+    }
+
+    trail.clear();
+    trailDomains.clear();
+    return true;
+}
+
+void WaveState::recountCell(size_t cell) {
+    const auto& weights = rules->getWeights();
+    const Word* domain = getDomain(cell);
+
+    weightSums[cell] = 0.0;
+    weightLogWeightSums[cell] = 0.0;
+
+    for (unsigned word = 0; word < wordCount; word++) {
+        for (Word bits = domain[word]; bits != 0; bits &= bits - 1) {
+            unsigned pattern = word * WORD_BITS + std::countr_zero(bits);
+
+            weightSums[cell] += weights[pattern];
+            weightLogWeightSums[cell] += weightLogWeights[pattern];
+        }
+    }
+
+    updateCell(cell);
+}
+
+void WaveState::updateCell(size_t cell) {
+    const Word* domain = getDomain(cell);
+
+    possibleCounts[cell] = 0;
+    for (unsigned word = 0; word < wordCount; word++) {
+        possibleCounts[cell] += std::popcount(domain[word]);
+    }
+
+    entropies[cell] = std::log(weightSums[cell]) - weightLogWeightSums[cell] / weightSums[cell];
+}
+
+void WaveState::pushEntropy(size_t cell) {
+    if (!noise.empty() && possibleCounts[cell] > 1) {
+        entropyHeap.emplace(entropies[cell] + noise[cell], cell);
+    }
+}
+
+// -1 once every cell is down to one pattern. Entries left behind by cells which have changed
+// since are dropped on the way
+int WaveState::findLowestEntropyCell(void) {
+    while (!entropyHeap.empty()) {
+        auto [entropy, cell] = entropyHeap.top();
+        entropyHeap.pop();
+
+        if (possibleCounts[cell] > 1 && entropy == entropies[cell] + noise[cell]) {
+            return static_cast<int>(cell);
+        }
+    }
+
+    return -1;
+}
@@ -1,99 +1,441 @@
 #include "generation/wfc/wfcstrategy.h"
+
+#include <atomic>
+
+#include "generation/roomplacer.h"
+#include "gridtraversal.h"
 #include "utils/randomutils.h"
+#include "utils/threadpool.h"
 #include "utils/timing.h"
+#include "walkableregions.h"
 
 using namespace SpaceRogueLite;
 
 WFCStrategy::WFCStrategy(const RoomConfiguration& roomConfiguration, const WFCTileSet& tileSet)
-    : GenerationStrategy(roomConfiguration), tileSet(tileSet) {}
+    : GenerationStrategy(roomConfiguration), tileSet(tileSet) {
+    const auto& wfcTiles = tileSet.getWFCTileVariants();
+
+    for (unsigned i = 0; i < wfcTiles.size(); i++) {
+        auto variant = wfcTiles[i].data[0].data[0].variant;
+
+        if (variant >= tileIndexByVariant.size()) {
+            tileIndexByVariant.resize(variant + 1, 0);
+        }
+
+        tileIndexByVariant[variant] = i;
+    }
+
+    const auto& rules = tileSet.getCompiledTileSet();
+
+    for (unsigned pattern = 0; pattern < rules.getPatternCount(); pattern++) {
+        const auto& wfcTile = rules.getPatternTile(pattern);
+
+        gridTileByPattern.push_back({wfcTile.tileId, wfcTile.variant,
+                                     tileSet.getTileWalkability(wfcTile.tileId),
+                                     wfcTile.orientation});
+    }
+}
 
 std::vector<GridTile> WFCStrategy::generate(void) {
     auto startTime = Utils::getMicroseconds();
     spdlog::info("Generating map ({}, {})... ", getWidth(), getHeight());
 
-    int numAttempts = 10;
+    if (getBlockSize() > 0) {
+        spdlog::info("Solving in {}x{} blocks", getBlockSize(), getBlockSize());
+    }
+
+    // Seeds are drawn up front so they don't depend on which attempts finish first
+    std::vector<int> seeds;
+    if (fixedSeed.has_value()) {
+        seeds.push_back(*fixedSeed);
+    } else {
+        for (int i = 0; i < NUM_ATTEMPTS; i++) {
+            seeds.push_back(Utils::randomRange(0, INT_MAX));
+        }
+    }
+
+    if (!createBaseStates()) {
+        spdlog::error("Map edge contradicts the tile set rules, cannot generate");
+        attemptReports.clear();
+        return {};
+    }
+
     int successfulAttempt = 0;
-    int seed = 0;
-    auto success = run(numAttempts, successfulAttempt, seed);
+    auto success = run(seeds, successfulAttempt);
+
+    baseStates.clear();
 
     if (!success.has_value()) {
-        return getData();
+        return {};
     }
 
-    for (int x = 0; x < getWidth(); x++) {
-        for (int y = 0; y < getHeight(); y++) {
-            auto const& wfcTile = (*success).data[y * getWidth() + x];
-
-            setTile(x, y,
-                    {wfcTile.tileId, wfcTile.name, tileSet.getTileWalkability(wfcTile.tileId),
-                     wfcTile.orientation});
-        }
+    clearRooms();
+    for (const auto& room : success->rooms) {
+        addRoom(room);
     }
 
     auto timeTaken = (Utils::getMicroseconds() - startTime) / 1000.0;
     spdlog::info("Map generation done ({}ms, {}/{} attempts) [seed={}]", timeTaken,
-                 successfulAttempt, numAttempts, seed);
+                 successfulAttempt, seeds.size(), success->report.seed);
+
+    // Handed straight over rather than copied, callers can move it on into the grid with
+    // Grid::setTiles
+    return std::move(*success->tiles);
+}
+
+void WFCStrategy::setSeed(int seed) { fixedSeed = seed; }
 
-    return getData();
+void WFCStrategy::setBlockSize(int blockSize) { this->blockSize = blockSize; }
+
+void WFCStrategy::setBacktrackLimit(int backtrackLimit) { this->backtrackLimit = backtrackLimit; }
+
+const std::vector<WFCStrategy::AttemptReport>& WFCStrategy::getAttemptReports(void) const {
+    return attemptReports;
 }
 
-std::optional<Array2D<WFCTileSet::WFCTile>> WFCStrategy::run(int numAttempts,
-                                                             int& successfulAttempt, int& seed) {
-    for (int i = 0; i < numAttempts; i++) {
-        seed = Utils::randomRange(0, INT_MAX);
-        // seed = 1969591651;
-        Utils::setRandomGeneratorSeed(seed);
-        auto success = runAttempt(seed);
+std::optional<WFCStrategy::AttemptResult> WFCStrategy::run(const std::vector<int>& seeds,
+                                                           int& successfulAttempt) {
+    const size_t numAttempts = seeds.size();
+    std::vector<AttemptResult> results(numAttempts);
+    std::vector<std::stop_source> stopSources(numAttempts);
 
-        if (success.has_value()) {
-            successfulAttempt = i + 1;
-            return success;
+    // A stop asked of the whole strategy cancels every attempt
+    std::stop_callback stopAttempts(getStopToken(), [&stopSources]() {
+        for (auto& stopSource : stopSources) {
+            stopSource.request_stop();
         }
+    });
+
+    // Each worker claims the next attempt in order, so earlier attempts (the ones which win if
+    // they succeed) always start first
+    std::atomic<size_t> nextAttempt = 0;
+
+    // Block solves already use every core, so attempts at a large map are made one at a time
+    size_t attemptsPerRange = getBlockSize() > 0 ? numAttempts : 1;
+
+    Utils::getThreadPool().parallelFor(numAttempts, attemptsPerRange, [&](size_t, size_t) {
+        for (size_t i = nextAttempt++; i < numAttempts; i = nextAttempt++) {
+            results[i] = runAttempt(seeds[i], stopSources[i].get_token());
+
+            // Later attempts can no longer win, earlier ones still can so they carry on
+            if (results[i].tiles.has_value()) {
+                for (size_t later = i + 1; later < numAttempts; later++) {
+                    stopSources[later].request_stop();
+                }
+            }
+        }
+    });
+
+    attemptReports.clear();
+    std::optional<size_t> winner;
 
-        spdlog::info("Failed to generate map with seed {}, retrying ({} of {} attempts)", seed,
-                     i + 1, numAttempts);
+    for (size_t i = 0; i < numAttempts; i++) {
+        const auto& report = results[i].report;
+        attemptReports.push_back(report);
+
+        spdlog::info("Attempt {} of {} with seed {}: {} ({}ms)", i + 1, numAttempts, report.seed,
+                     getOutcomeName(report.outcome), report.timeMs);
+
+        if (!winner.has_value() && report.outcome == AttemptReport::SUCCEEDED) {
+            winner = i;
+        }
+    }
+
+    if (!winner.has_value() && isStopRequested()) {
+        spdlog::info("Map generation stopped");
+        return std::nullopt;
     }
 
-    spdlog::warn("Failed to generate map after {} attempts", numAttempts);
-    return std::nullopt;
+    if (!winner.has_value()) {
+        spdlog::warn("Failed to generate map after {} attempts", numAttempts);
+        return std::nullopt;
+    }
+
+    successfulAttempt = static_cast<int>(*winner) + 1;
+    return std::move(results[*winner]);
 }
 
-std::optional<Array2D<WFCTileSet::WFCTile>> WFCStrategy::runAttempt(int seed) {
-    auto wfcTiles = tileSet.getWFCTileVariants();
-    auto neighbours = tileSet.getNeighbours();
+WFCStrategy::AttemptResult WFCStrategy::runAttempt(int seed, std::stop_token stopToken) const {
+    auto startTime = Utils::getMicroseconds();
+
+    AttemptResult result;
+    result.report = {seed, AttemptReport::CANCELLED, 0.0};
+
+    if (!stopToken.stop_requested()) {
+        // Every stream an attempt draws from is derived from its seed alone: rooms from the
+        // ROOM_STREAM split, a whole map solve from RandomGenerator(seed) inside WaveState, and
+        // each block from splits on its coordinates and attempt. So a seed reproduces the whole
+        // map, and rooms don't reuse the numbers the solve draws
+        auto rng = Utils::RandomGenerator(seed).split(ROOM_STREAM);
+        std::vector<int> fixedTiles(getWidth() * getHeight(), FREE_TILE);
+
+        if (generateRoomsAndPaths(fixedTiles, rng, result.rooms, stopToken) &&
+            !stopToken.stop_requested()) {
+            result.tiles = getBlockSize() > 0 ? solveInBlocks(fixedTiles, seed, stopToken)
+                                              : solve(fixedTiles, seed);
+
+            if (!result.tiles.has_value()) {
+                result.report.outcome = stopToken.stop_requested() ? AttemptReport::CANCELLED
+                                                                   : AttemptReport::CONTRADICTION;
+            } else if (!areRoomsConnected(*result.tiles, result.rooms)) {
+                result.tiles.reset();
+                result.report.outcome = AttemptReport::UNREACHABLE_ROOMS;
+            } else {
+                result.report.outcome = AttemptReport::SUCCEEDED;
+            }
+        }
+    }
 
-    TilingWFC<WFCTileSet::WFCTile> wfc(wfcTiles, neighbours, getHeight(), getWidth(), {false},
-                                       seed);
+    result.report.timeMs = (Utils::getMicroseconds() - startTime) / 1000.0;
+    return result;
+}
 
-    generateMapEdge(wfc);
-    generateRoomsAndPaths(wfc);
+int WFCStrategy::getBlockSize(void) const {
+    if (blockSize > 0) {
+        // Blocks solved in the same phase mustn't overlap each other
+        return std::max(blockSize, 2 * BLOCK_OVERLAP);
+    }
 
-    return wfc.run();
+    if (getWidth() > MAX_SINGLE_SOLVE_SIZE || getHeight() > MAX_SINGLE_SOLVE_SIZE) {
+        return DEFAULT_BLOCK_SIZE;
+    }
+
+    return 0;
 }
 
-void WFCStrategy::generateMapEdge(TilingWFC<WFCTileSet::WFCTile>& wfc) {
+std::optional<std::vector<GridTile>> WFCStrategy::solve(const std::vector<int>& fixedTiles,
+                                                        int seed) const {
+    const glm::ivec2 mapSize(getWidth(), getHeight());
+    WaveState wave = baseStates.find(getBaseStateKey(glm::ivec2(0), mapSize))->second;
+
     for (int y = 0; y < getHeight(); y++) {
         for (int x = 0; x < getWidth(); x++) {
+            if (fixedTiles[y * getWidth() + x] != FREE_TILE) {
+                wave.setTile(x, y, fixedTiles[y * getWidth() + x], 0);
+            }
+        }
+    }
+
+    auto patterns = wave.solve(seed, backtrackLimit);
+    if (!patterns.has_value()) {
+        return std::nullopt;
+    }
+
+    std::vector<GridTile> tiles(patterns->data.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+        tiles[i] = gridTileByPattern[patterns->data[i]];
+    }
+
+    return tiles;
+}
+
+std::optional<std::vector<GridTile>> WFCStrategy::solveInBlocks(const std::vector<int>& fixedTiles,
+                                                                int seed,
+                                                                std::stop_token stopToken) const {
+    const int blocksX = (getWidth() + getBlockSize() - 1) / getBlockSize();
+    const int blocksY = (getHeight() + getBlockSize() - 1) / getBlockSize();
+
+    std::vector<GridTile> tiles(getWidth() * getHeight(), TILE_DEFAULT);
+    std::vector<uint8_t> isSolved(getWidth() * getHeight(), false);
+    std::atomic<bool> isFailed = false;
+
+    // Blocks of the same phase are two blocks apart, so their overlaps never meet and they only
+    // read tiles solved in earlier phases. That keeps the result independent of thread timing
+    for (int phase = 0; phase < 4; phase++) {
+        std::vector<glm::ivec2> blocks;
+
+        for (int blockY = phase / 2; blockY < blocksY; blockY += 2) {
+            for (int blockX = phase % 2; blockX < blocksX; blockX += 2) {
+                blocks.push_back(glm::ivec2(blockX, blockY));
+            }
+        }
+
+        std::atomic<size_t> nextBlock = 0;
+
+        Utils::getThreadPool().parallelFor(blocks.size(), 1, [&](size_t, size_t) {
+            for (size_t i = nextBlock++; i < blocks.size(); i = nextBlock++) {
+                if (isFailed || stopToken.stop_requested()) {
+                    return;
+                }
+
+                if (!solveBlock(fixedTiles, blocks[i], seed, tiles, isSolved)) {
+                    isFailed = true;
+                }
+            }
+        });
+
+        if (isFailed || stopToken.stop_requested()) {
+            return std::nullopt;
+        }
+    }
+
+    return tiles;
+}
+
+bool WFCStrategy::solveBlock(const std::vector<int>& fixedTiles, const glm::ivec2& block, int seed,
+                             std::vector<GridTile>& tiles, std::vector<uint8_t>& isSolved) const {
+    const glm::ivec2 mapSize(getWidth(), getHeight());
+
+    glm::ivec2 min, max;
+    getBlockRegion(block, min, max);
+    auto size = max - min;
+
+    const auto& baseState = baseStates.find(getBaseStateKey(min, max))->second;
+
+    // The outer ring of the region (apart from along the map edge) keeps the tiles already solved
+    // there and isn't written back, so the block always joins up with what's outside it. Solved
+    // tiles inside the ring are solved again, which gives the block room to fit its neighbours
+    auto isBorder = [&](int x, int y) {
+        return (x == min.x && min.x > 0) || (y == min.y && min.y > 0) ||
+               (x == max.x - 1 && max.x < mapSize.x) || (y == max.y - 1 && max.y < mapSize.y);
+    };
+
+    for (int attempt = 0; attempt < MAX_BLOCK_ATTEMPTS; attempt++) {
+        auto blockRng = Utils::RandomGenerator(seed).split(block.x).split(block.y).split(attempt);
+
+        WaveState wave = baseState;
+
+        for (int y = min.y; y < max.y; y++) {
+            for (int x = min.x; x < max.x; x++) {
+                int index = y * mapSize.x + x;
+
+                if (isBorder(x, y) && isSolved[index]) {
+                    const auto& tile = tiles[index];
+                    wave.setTile(x - min.x, y - min.y, tileIndexByVariant[tile.variant],
+                                 tile.orientation);
+                } else if (fixedTiles[index] != FREE_TILE) {
+                    wave.setTile(x - min.x, y - min.y, fixedTiles[index], 0);
+                }
+            }
+        }
+
+        auto patterns = wave.solve(Utils::randomRange(blockRng, 0, INT_MAX), backtrackLimit);
+        if (!patterns.has_value()) {
+            spdlog::debug("Block ({}, {}) attempt {} hit a contradiction", block.x, block.y,
+                          attempt + 1);
+            continue;
+        }
+
+        for (int y = min.y; y < max.y; y++) {
+            for (int x = min.x; x < max.x; x++) {
+                if (!isBorder(x, y)) {
+                    auto pattern = patterns->data[(y - min.y) * size.x + x - min.x];
+                    tiles[y * mapSize.x + x] = gridTileByPattern[pattern];
+                    isSolved[y * mapSize.x + x] = true;
+                }
+            }
+        }
+
+        // Only the tiles inside the ring were written
+        glm::ivec2 writtenMin = min + glm::ivec2(min.x > 0, min.y > 0);
+        glm::ivec2 writtenMax = max - glm::ivec2(max.x < mapSize.x, max.y < mapSize.y);
+        reportProgress({writtenMin.x, writtenMin.y, writtenMax.x - writtenMin.x,
+                        writtenMax.y - writtenMin.y},
+                       tiles);
+
+        return true;
+    }
+
+    spdlog::warn("Block ({}, {}) failed after {} attempts", block.x, block.y, MAX_BLOCK_ATTEMPTS);
+    return false;
+}
+
+bool WFCStrategy::createBaseStates(void) {
+    const glm::ivec2 mapSize(getWidth(), getHeight());
+    std::vector<std::pair<glm::ivec2, glm::ivec2>> regions;
+
+    if (getBlockSize() == 0) {
+        regions.push_back({glm::ivec2(0), mapSize});
+    } else {
+        for (int blockY = 0; blockY * getBlockSize() < getHeight(); blockY++) {
+            for (int blockX = 0; blockX * getBlockSize() < getWidth(); blockX++) {
+                glm::ivec2 min, max;
+                getBlockRegion(glm::ivec2(blockX, blockY), min, max);
+                regions.push_back({min, max});
+            }
+        }
+    }
+
+    baseStates.clear();
+
+    for (const auto& [min, max] : regions) {
+        auto key = getBaseStateKey(min, max);
+
+        if (baseStates.contains(key)) {
+            continue;
+        }
+
+        WaveState wave(tileSet.getCompiledTileSet(), max.x - min.x, max.y - min.y);
+        generateMapEdge(wave, min);
+
+        if (!wave.propagate()) {
+            return false;
+        }
+
+        baseStates.emplace(key, std::move(wave));
+    }
+
+    return true;
+}
+
+// Regions only differ in which map edges run along them, so same sized regions touching the same
+// edges share a base state
+WFCStrategy::BaseStateKey WFCStrategy::getBaseStateKey(const glm::ivec2& min,
+                                                       const glm::ivec2& max) const {
+    int edges = (min.x == 0 ? 1 : 0) | (min.y == 0 ? 2 : 0) | (max.x == getWidth() ? 4 : 0) |
+                (max.y == getHeight() ? 8 : 0);
+
+    return {max.x - min.x, max.y - min.y, edges};
+}
+
+// The block plus BLOCK_OVERLAP tiles either side, max is exclusive
+void WFCStrategy::getBlockRegion(const glm::ivec2& block, glm::ivec2& min, glm::ivec2& max) const {
+    min = glm::max(block * getBlockSize() - BLOCK_OVERLAP, glm::ivec2(0));
+    max = glm::min((block + 1) * getBlockSize() + BLOCK_OVERLAP,
+                   glm::ivec2(getWidth(), getHeight()));
+}
+
+void WFCStrategy::generateMapEdge(WaveState& wave, const glm::ivec2& min) const {
+    for (int y = min.y; y < min.y + wave.getHeight(); y++) {
+        for (int x = min.x; x < min.x + wave.getWidth(); x++) {
             if (x == 0 || y == 0 || x == getWidth() - 1 || y == getHeight() - 1) {
-                wfc.set_tile(tileSet.getEdgeTileIndex(), 0, y, x);
+                wave.setTile(x - min.x, y - min.y, tileSet.getEdgeTileIndex(), 0);
             }
         }
     }
 }
 
-void WFCStrategy::generateRoomsAndPaths(TilingWFC<WFCTileSet::WFCTile>& wfc) {
-    auto& grid = entt::locator<SpaceRogueLite::Grid>::value();
+bool WFCStrategy::generateRoomsAndPaths(std::vector<int>& fixedTiles,
+                                        Utils::RandomGenerator& rng, std::vector<Room>& rooms,
+                                        std::stop_token stopToken) const {
     std::vector<glm::ivec2> roomCenterPoints;
 
     auto numRooms = getRoomConfiguration().numRooms;
-    clearRooms();
+    rooms.clear();
+
+    RoomPlacer placer(*this);
 
     for (int i = 0; i < numRooms; i++) {
-        auto room = generateRoom(wfc, getRooms());
-        addRoom(room);
+        if (stopToken.stop_requested()) {
+            return false;
+        }
+
+        auto room = placer.place(rng);
+        if (!room.has_value()) {
+            spdlog::warn("Only found space for {} of {} rooms", rooms.size(), numRooms);
+            break;
+        }
+
+        rooms.push_back(*room);
 
-        roomCenterPoints.push_back(glm::ivec2(Utils::randomRange(room.min.x, room.max.x),
-                                              Utils::randomRange(room.min.y, room.max.y)));
+        for (int x = room->min.x; x <= room->max.x; x++) {
+            for (int y = room->min.y; y <= room->max.y; y++) {
+                fixedTiles[y * getWidth() + x] = tileSet.getRoomTileIndex();
+            }
+        }
+
+        roomCenterPoints.push_back(glm::ivec2(Utils::randomRange(rng, room->min.x, room->max.x),
+                                              Utils::randomRange(rng, room->min.y, room->max.y)));
     }
 
     std::sort(roomCenterPoints.begin(), roomCenterPoints.end(),
@@ -101,47 +443,60 @@ void WFCStrategy::generateRoomsAndPaths(TilingWFC<WFCTileSet::WFCTile>& wfc) {
                   return a.x < b.x || (a.x == b.x && a.y < b.y);
               });
 
+    // Supercover keeps corridors 4-connected where they pass diagonally through a tile corner
     for (int i = 1; i < roomCenterPoints.size(); i++) {
-        auto p1 = roomCenterPoints[i - 1];
-        auto p2 = roomCenterPoints[i];
-        auto intersections = grid.getIntersections(roomCenterPoints[i - 1], roomCenterPoints[i]);
-
-        for (auto intersection : intersections) {
-            wfc.set_tile(tileSet.getRoomTileIndex(), 0, intersection.y, intersection.x);
-        }
+        traverseGrid(roomCenterPoints[i - 1], roomCenterPoints[i], TraversalMode::SUPERCOVER,
+                     [&](int x, int y) {
+                         if (x >= 0 && y >= 0 && x < getWidth() && y < getHeight()) {
+                             fixedTiles[y * getWidth() + x] = tileSet.getRoomTileIndex();
+                         }
+                     });
     }
-}
 
-GenerationStrategy::Room WFCStrategy::generateRoom(TilingWFC<WFCTileSet::WFCTile>& wfc,
-                                                   const std::vector<Room>& existingRooms) {
-    Room room;
-    bool isValid = false;
+    return true;
+}
 
-    while (!isValid) {
-        room = createRandomRoom();
+bool WFCStrategy::areRoomsConnected(const std::vector<GridTile>& tiles,
+                                    const std::vector<Room>& rooms) const {
+    WalkabilityBitmap walkability(getWidth(), getHeight());
 
-        if (!hasCollision(room, existingRooms) && isSparse(room, existingRooms)) {
-            isValid = true;
+    for (int y = 0; y < getHeight(); y++) {
+        for (int x = 0; x < getWidth(); x++) {
+            walkability.setWalkable(x, y, tiles[y * getWidth() + x].walkable == GridTile::WALKABLE);
         }
     }
 
-    for (int x = room.min.x; x <= room.max.x; x++) {
-        for (int y = room.min.y; y <= room.max.y; y++) {
-            wfc.set_tile(tileSet.getRoomTileIndex(), 0, y, x);
+    WalkableRegions regions;
+    regions.update(walkability);
+
+    // Isolated pockets elsewhere are fine, only the rooms need to reach each other
+    int32_t region = WalkableRegions::NO_REGION;
+
+    for (const auto& room : rooms) {
+        int32_t roomRegion = regions.getRegion(room.min.x, room.min.y);
+
+        if (roomRegion == WalkableRegions::NO_REGION ||
+            (region != WalkableRegions::NO_REGION && roomRegion != region)) {
+            return false;
         }
+
+        region = roomRegion;
     }
 
-    return room;
+    return true;
 }
 
-GenerationStrategy::Room WFCStrategy::createRandomRoom(void) {
-    int roomSizeX = Utils::randomRange(getRoomConfiguration().minRoomSize.x,
-                                       getRoomConfiguration().maxRoomSize.x);
-    int roomSizeY = Utils::randomRange(getRoomConfiguration().minRoomSize.y,
-                                       getRoomConfiguration().maxRoomSize.y);
-
-    int roomX = Utils::randomRange(1, getWidth() - roomSizeX - 1);
-    int roomY = Utils::randomRange(1, getHeight() - roomSizeY - 1);
-
-    return {glm::ivec2(roomX, roomY), glm::ivec2(roomX + roomSizeX, roomY + roomSizeY)};
-}
\ No newline at end of file
+const char* WFCStrategy::getOutcomeName(AttemptReport::Outcome outcome) {
+    switch (outcome) {
+        case AttemptReport::SUCCEEDED:
+            return "succeeded";
+        case AttemptReport::CONTRADICTION:
+            return "contradiction";
+        case AttemptReport::UNREACHABLE_ROOMS:
+            return "unreachable rooms";
+        case AttemptReport::CANCELLED:
+            return "cancelled";
+        default:
+            return "unknown";
+    }
+}
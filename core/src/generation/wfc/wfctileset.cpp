@@ -2,8 +2,96 @@
 
 #include <spdlog/spdlog.h>
 
+#include <bit>
+#include <cstring>
+#include <iterator>
+
+#include "generation/wfc/compiledtileset.h"
+
 using namespace SpaceRogueLite;
 
+namespace {
+
+// Fields are written as they sit in memory
+static_assert(std::endian::native == std::endian::little,
+              "WFCTileSet expects a little endian host");
+
+constexpr char CACHE_MAGIC[4] = {'S', 'R', 'T', 'S'};
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t formatVersion;
+    uint64_t rulesHash;
+};
+
+struct CachedTile {
+    double weight;
+    TileId tileId;
+    uint16_t textureId;
+    uint8_t symmetry;
+    uint8_t walkable;
+};
+
+static_assert(sizeof(CacheHeader) == 16);
+static_assert(sizeof(CachedTile) == 16);
+
+struct CacheReader {
+    std::vector<uint8_t> data;
+    size_t offset = 0;
+
+    template <typename T>
+    bool read(T& value) {
+        if (data.size() - offset < sizeof(T)) {
+            return false;
+        }
+
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    // Counts that would need more bytes than are left are corrupt, so aren't allocated for
+    bool readCount(uint32_t& count, size_t elementSize) {
+        return read(count) && count <= (data.size() - offset) / elementSize;
+    }
+
+    bool readString(std::string& value) {
+        uint16_t length;
+        if (!read(length) || data.size() - offset < length) {
+            return false;
+        }
+
+        value.assign(reinterpret_cast<const char*>(data.data() + offset), length);
+        offset += length;
+        return true;
+    }
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& buffer, const T& value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void appendString(std::vector<uint8_t>& buffer, const std::string& value) {
+    append(buffer, static_cast<uint16_t>(value.size()));
+    buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+// FNV-1a, enough to notice the rules changing
+uint64_t hashRules(const std::string& rules) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (char c : rules) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+}  // namespace
+
 WFCTileSet::WFCTileSet(const std::string& rulesFile)
     : rulesFile(rulesFile), isLoaded(false), isError(false), edgeTileIndex(0), roomTileIndex(0) {}
 
@@ -29,12 +117,36 @@ void WFCTileSet::load(void) {
         return;
     }
 
-    json data = json::parse(std::ifstream(rulesFile));
+    std::ifstream rulesStream(rulesFile, std::ios::binary);
+    std::string rules((std::istreambuf_iterator<char>(rulesStream)),
+                      std::istreambuf_iterator<char>());
+
+    auto rulesHash = hashRules(rules);
+
+    if (loadCache(rulesHash)) {
+        spdlog::info("Loaded compiled tileset '{}' from cache", rulesFile);
+    } else {
+        clearRules();
+
+        if (!loadRules(rules)) {
+            return;
+        }
+
+        compiledTileSet = std::make_shared<const CompiledTileSet>(tiles, neighbours);
+        saveCache(rulesHash);
+    }
+
+    isError = false;
+    isLoaded = true;
+}
+
+bool WFCTileSet::loadRules(const std::string& rules) {
+    json data = json::parse(rules);
 
     auto tilesByName = parseTileDefinitions(data["tiles"]);
 
     if (!tilesByName) {
-        return;
+        return false;
     }
 
     auto walkableSet = data["walkableTiles"].get<std::set<unsigned>>();
@@ -46,12 +158,12 @@ void WFCTileSet::load(void) {
         index++;
 
         walkableTiles[tile.tileId] = walkableSet.contains(tile.tileId);
-        tileVariants.insert(
-            {tile.tileId, tile.name, tile.textureId, toTextureSymmetry(tile.symmetry)});
+        tileVariants.insert({tile.tileId, tile.variant, tile.name, tile.textureId,
+                             toTextureSymmetry(tile.symmetry)});
 
         auto wfcTile = buildWFCTile(tile);
         if (!wfcTile) {
-            return;
+            return false;
         }
 
         tiles.push_back(*wfcTile);
@@ -62,8 +174,237 @@ void WFCTileSet::load(void) {
     edgeTileIndex = nameToIndex.at(data["edgeTile"].get<std::string>());
     roomTileIndex = nameToIndex.at(data["rooms"]["roomTile"].get<std::string>());
 
-    isError = false;
-    isLoaded = true;
+    return true;
+}
+
+// Anything missing, stale or malformed is a miss, the caller falls back to the rules
+bool WFCTileSet::loadCache(uint64_t rulesHash) {
+    std::ifstream stream(getCachePath(), std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    CacheReader reader{std::vector<uint8_t>((std::istreambuf_iterator<char>(stream)),
+                                            std::istreambuf_iterator<char>())};
+
+    CacheHeader header;
+    if (!reader.read(header) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.formatVersion != CACHE_FORMAT_VERSION || header.rulesHash != rulesHash) {
+        return false;
+    }
+
+    clearRules();
+
+    uint32_t variantCount;
+    if (!reader.readCount(variantCount, sizeof(uint16_t))) {
+        return false;
+    }
+
+    // Variants are interned in their original order so ids match a load from the rules
+    for (uint32_t i = 0; i < variantCount; i++) {
+        std::string type;
+        if (!reader.readString(type) || !variantTable.intern(type)) {
+            return false;
+        }
+    }
+
+    uint32_t tileCount;
+    if (!reader.readCount(tileCount, sizeof(CachedTile))) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < tileCount; i++) {
+        std::string name;
+        CachedTile cached;
+
+        if (!reader.readString(name) || !reader.read(cached) ||
+            cached.symmetry > static_cast<uint8_t>(Symmetry::P)) {
+            return false;
+        }
+
+        auto variant = variantTable.find(name);
+        if (!variant) {
+            return false;
+        }
+
+        WFCTile tile = {
+            .tileId = cached.tileId,
+            .symmetry = static_cast<Symmetry>(cached.symmetry),
+            .name = name,
+            .variant = *variant,
+            .weight = cached.weight,
+            .textureId = cached.textureId,
+            .orientation = 0,
+        };
+
+        walkableTiles[tile.tileId] = cached.walkable != 0;
+        tileVariants.insert({tile.tileId, tile.variant, tile.name, tile.textureId,
+                             toTextureSymmetry(tile.symmetry)});
+
+        auto wfcTile = buildWFCTile(tile);
+        if (!wfcTile) {
+            return false;
+        }
+
+        tiles.push_back(*wfcTile);
+    }
+
+    uint32_t neighbourCount;
+    if (!reader.readCount(neighbourCount, 4 * sizeof(uint32_t))) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < neighbourCount; i++) {
+        uint32_t neighbour[4];
+        if (!reader.read(neighbour) || neighbour[0] >= tileCount || neighbour[2] >= tileCount) {
+            return false;
+        }
+
+        neighbours.push_back({neighbour[0], neighbour[1], neighbour[2], neighbour[3]});
+    }
+
+    uint32_t edgeTile, roomTile;
+    if (!reader.read(edgeTile) || !reader.read(roomTile) || edgeTile >= tileCount ||
+        roomTile >= tileCount) {
+        return false;
+    }
+
+    edgeTileIndex = edgeTile;
+    roomTileIndex = roomTile;
+
+    uint32_t patternCount;
+    if (!reader.readCount(patternCount, sizeof(double))) {
+        return false;
+    }
+
+    std::vector<double> weights(patternCount);
+    for (auto& weight : weights) {
+        if (!reader.read(weight)) {
+            return false;
+        }
+    }
+
+    Propagator::PropagatorState propagator(patternCount);
+
+    for (auto& directions : propagator) {
+        for (auto& allowed : directions) {
+            uint32_t allowedCount;
+            if (!reader.readCount(allowedCount, sizeof(uint32_t))) {
+                return false;
+            }
+
+            allowed.resize(allowedCount);
+
+            for (auto& pattern : allowed) {
+                uint32_t value;
+                if (!reader.read(value) || value >= patternCount) {
+                    return false;
+                }
+
+                pattern = value;
+            }
+        }
+    }
+
+    auto compiled =
+        std::make_shared<const CompiledTileSet>(tiles, std::move(weights), std::move(propagator));
+
+    if (compiled->getPatternCount() != patternCount) {
+        return false;
+    }
+
+    compiledTileSet = std::move(compiled);
+    return true;
+}
+
+// A missing cache only costs the next load its compile, so failing to write one isn't an error
+void WFCTileSet::saveCache(uint64_t rulesHash) const {
+    std::vector<uint8_t> buffer;
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.formatVersion = CACHE_FORMAT_VERSION;
+    header.rulesHash = rulesHash;
+    append(buffer, header);
+
+    // Skipping TILE_VARIANT_NONE, which every table starts with
+    append(buffer, static_cast<uint32_t>(variantTable.size() - 1));
+    for (size_t variant = 1; variant < variantTable.size(); variant++) {
+        appendString(buffer, variantTable.getType(static_cast<TileVariantId>(variant)));
+    }
+
+    append(buffer, static_cast<uint32_t>(tiles.size()));
+    for (const auto& wfcTile : tiles) {
+        const auto& tile = wfcTile.data[0].data[0];
+
+        appendString(buffer, tile.name);
+        append(buffer, CachedTile{
+                           .weight = tile.weight,
+                           .tileId = tile.tileId,
+                           .textureId = tile.textureId,
+                           .symmetry = static_cast<uint8_t>(tile.symmetry),
+                           .walkable = static_cast<uint8_t>(
+                               getTileWalkability(tile.tileId) == GridTile::WALKABLE),
+                       });
+    }
+
+    append(buffer, static_cast<uint32_t>(neighbours.size()));
+    for (const auto& [tile1, orientation1, tile2, orientation2] : neighbours) {
+        uint32_t neighbour[4] = {tile1, orientation1, tile2, orientation2};
+        append(buffer, neighbour);
+    }
+
+    append(buffer, static_cast<uint32_t>(edgeTileIndex));
+    append(buffer, static_cast<uint32_t>(roomTileIndex));
+
+    append(buffer, static_cast<uint32_t>(compiledTileSet->getPatternCount()));
+    for (double weight : compiledTileSet->getWeights()) {
+        append(buffer, weight);
+    }
+
+    for (const auto& directions : compiledTileSet->getPropagator()) {
+        for (const auto& allowed : directions) {
+            append(buffer, static_cast<uint32_t>(allowed.size()));
+            for (unsigned pattern : allowed) {
+                append(buffer, static_cast<uint32_t>(pattern));
+            }
+        }
+    }
+
+    // Written aside and renamed into place so a concurrent load never sees half a file
+    auto cachePath = getCachePath();
+    auto tempPath = cachePath + ".tmp";
+
+    {
+        std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+        if (!stream) {
+            spdlog::warn("Could not write tileset cache '{}'", tempPath);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+
+    if (error) {
+        spdlog::warn("Could not write tileset cache '{}': {}", cachePath, error.message());
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+std::string WFCTileSet::getCachePath(void) const { return rulesFile + ".cache"; }
+
+void WFCTileSet::clearRules(void) {
+    tiles.clear();
+    neighbours.clear();
+    walkableTiles.clear();
+    tileVariants.clear();
+    variantTable.clear();
+    compiledTileSet.reset();
+    edgeTileIndex = 0;
+    roomTileIndex = 0;
 }
 
 std::optional<std::unordered_map<std::string, WFCTileSet::WFCTile>> WFCTileSet::parseTileDefinitions(
@@ -79,10 +420,18 @@ std::optional<std::unordered_map<std::string, WFCTileSet::WFCTile>> WFCTileSet::
             return std::nullopt;
         }
 
+        auto variant = variantTable.intern(name);
+
+        if (!variant) {
+            spdlog::error("Too many tile variants in rules {}, cannot intern '{}'", rulesFile, name);
+            return std::nullopt;
+        }
+
         tilesByName[name] = {
             .tileId = tileJson["tile_id"].get<uint8_t>(),
             .symmetry = getSymmetry(tileJson["symmetry"].get<std::string>()),
             .name = name,
+            .variant = *variant,
             .weight = tileJson["weight"].get<double>(),
             .textureId = tileJson["textureId"].get<uint16_t>(),
             .orientation = 0,
@@ -133,10 +482,7 @@ void WFCTileSet::parseNeighbours(const json& neighboursJson,
 }
 
 void WFCTileSet::reset(void) {
-    tiles.clear();
-    neighbours.clear();
-    walkableTiles.clear();
-    tileVariants.clear();
+    clearRules();
     isLoaded = false;
     isError = false;
 }
@@ -173,16 +519,22 @@ const std::vector<Tile<WFCTileSet::WFCTile>>& WFCTileSet::getWFCTileVariants(voi
 
 const std::set<TileVariant>& WFCTileSet::getTileVariants(void) const { return tileVariants; }
 
+const TileVariantTable& WFCTileSet::getVariantTable(void) const { return variantTable; }
+
 const std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>>& WFCTileSet::getNeighbours(
     void) const {
     return neighbours;
 }
 
+const CompiledTileSet& WFCTileSet::getCompiledTileSet(void) const { return *compiledTileSet; }
+
 const std::unordered_map<TileId, bool>& WFCTileSet::getWalkableTiles(void) const { return walkableTiles; }
 
-GridTile::Walkability WFCTileSet::getTileWalkability(TileId id) {
-    if (walkableTiles.contains(id)) {
-        return walkableTiles[id] ? GridTile::WALKABLE : GridTile::BLOCKED;
+GridTile::Walkability WFCTileSet::getTileWalkability(TileId id) const {
+    auto walkable = walkableTiles.find(id);
+
+    if (walkable != walkableTiles.end() && walkable->second) {
+        return GridTile::WALKABLE;
     }
 
     return GridTile::BLOCKED;
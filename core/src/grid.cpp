@@ -1,11 +1,26 @@
 #include <grid.h>
+#include <gridsnapshot.h>
+#include <gridtraversal.h>
 
 #include <algorithm>
+#include <utility>
 
 namespace SpaceRogueLite {
 
-Grid::Grid(int width, int height) : width(width), height(height) {
-    tiles.resize(width * height, TILE_DEFAULT);
+namespace {
+
+int pageCountFor(int tiles) { return (tiles + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE; }
+
+int chunkCountFor(int tiles) { return (tiles + Grid::CHUNK_SIZE - 1) / Grid::CHUNK_SIZE; }
+
+size_t pageTileIndex(int x, int y) {
+    return (y % Grid::PAGE_SIZE) * Grid::PAGE_SIZE + (x % Grid::PAGE_SIZE);
+}
+
+}  // namespace
+
+Grid::Grid(int width, int height) : width(0), height(0), pageTable(createPageTable(0, 0)) {
+    resize(width, height);
     markAllDirty();
 }
 
@@ -14,10 +29,21 @@ void Grid::setTile(int x, int y, const GridTile& tile) {
         return;
     }
 
-    size_t index = y * width + x;
-    if (tiles[index] != tile) {
-        tiles[index] = tile;
-        expandDirtyRegion(x, y);
+    size_t index = pageTileIndex(x, y);
+    const GridTile& current = getPage(x, y).tiles[index];
+    if (current == tile) {
+        return;
+    }
+
+    bool walkabilityChanged = current.walkable != tile.walkable;
+
+    getWritablePage(x, y).tiles[index] = tile;
+    markChunkDirty(x, y);
+    version++;
+
+    if (walkabilityChanged) {
+        walkability.setWalkable(x, y, tile.walkable == GridTile::WALKABLE);
+        regions.onWalkabilityChanged(walkability, x, y);
     }
 }
 
@@ -28,145 +54,473 @@ void Grid::setTiles(const std::vector<GridTile>& newTiles, int newWidth, int new
 
     width = newWidth;
     height = newHeight;
-    tiles = newTiles;
+    pageCountX = pageCountFor(width);
+    pageCountY = pageCountFor(height);
+    pageTable = createPageTable(pageCountX, pageCountY);
+    walkability.resize(width, height);
+
+    // Rows are copied a page wide at a time, pages which would only hold TILE_DEFAULT are left as
+    // the sentinel
+    for (int pageY = 0; pageY < pageCountY; ++pageY) {
+        for (int pageX = 0; pageX < pageCountX; ++pageX) {
+            int minX = pageX * PAGE_SIZE;
+            int minY = pageY * PAGE_SIZE;
+            int spanWidth = std::min(PAGE_SIZE, width - minX);
+            int spanHeight = std::min(PAGE_SIZE, height - minY);
+            TilePage* page = nullptr;
+
+            for (int row = 0; row < spanHeight; ++row) {
+                auto source = newTiles.begin() + (minY + row) * width + minX;
+
+                if (page == nullptr &&
+                    std::all_of(source, source + spanWidth,
+                                [](const GridTile& tile) { return tile == TILE_DEFAULT; })) {
+                    continue;
+                }
+
+                if (page == nullptr) {
+                    page = &getWritablePage(minX, minY);
+                }
+
+                std::copy_n(source, spanWidth, page->tiles.begin() + row * PAGE_SIZE);
+            }
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (newTiles[y * width + x].walkable == GridTile::WALKABLE) {
+                walkability.setWalkable(x, y, true);
+            }
+        }
+    }
+
+    regions.invalidate();
     markAllDirty();
+    version++;
+}
+
+void Grid::setTiles(std::vector<GridTile>&& newTiles, int newWidth, int newHeight) {
+    setTiles(std::as_const(newTiles), newWidth, newHeight);
+    std::vector<GridTile>().swap(newTiles);
+}
+
+void Grid::setRegion(const GridRegion& region, std::span<const GridTile> regionTiles) {
+    if (regionTiles.size() != static_cast<size_t>(region.width * region.height)) {
+        return;
+    }
+
+    const int startX = std::max(0, region.x);
+    const int startY = std::max(0, region.y);
+    const int endX = std::min(width, region.x + region.width);
+    const int endY = std::min(height, region.y + region.height);
+    bool isChanged = false;
+    bool walkabilityChanged = false;
+
+    // Compared a chunk wide span at a time, so unchanged chunks are neither dirtied nor copied out
+    // of a snapshot
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX;) {
+            const int length = std::min(endX, (x / CHUNK_SIZE + 1) * CHUNK_SIZE) - x;
+            const size_t offset = static_cast<size_t>(y - region.y) * region.width + x - region.x;
+            const GridTile* source = regionTiles.data() + offset;
+            const GridTile* current = &getPage(x, y).tiles[pageTileIndex(x, y)];
+
+            if (!std::equal(source, source + length, current)) {
+                for (int i = 0; i < length; ++i) {
+                    if (current[i].walkable != source[i].walkable) {
+                        walkability.setWalkable(x + i, y, source[i].walkable == GridTile::WALKABLE);
+                        walkabilityChanged = true;
+                    }
+                }
+
+                std::copy_n(source, length, &getWritablePage(x, y).tiles[pageTileIndex(x, y)]);
+                markChunkDirty(x, y);
+                isChanged = true;
+            }
+
+            x += length;
+        }
+    }
+
+    if (walkabilityChanged) {
+        regions.invalidate();
+    }
+
+    if (isChanged) {
+        version++;
+    }
+}
+
+void Grid::setPages(std::vector<std::shared_ptr<TilePage>> newPages, int newWidth,
+                    int newHeight) {
+    if (newPages.size() != static_cast<size_t>(pageCountFor(newWidth) * pageCountFor(newHeight))) {
+        return;
+    }
+
+    width = newWidth;
+    height = newHeight;
+    pageCountX = pageCountFor(width);
+    pageCountY = pageCountFor(height);
+    pageTable = createPageTable(pageCountX, pageCountY);
+
+    for (int pageY = 0; pageY < pageCountY; ++pageY) {
+        auto& row = *(*pageTable)[pageY];
+
+        for (int pageX = 0; pageX < pageCountX; ++pageX) {
+            if (auto& page = newPages[pageY * pageCountX + pageX]) {
+                row[pageX] = std::move(page);
+            }
+        }
+    }
+
+    rebuildWalkability();
+    markAllDirty();
+    version++;
 }
 
 GridTile Grid::getTile(int x, int y) const {
     if (!isValidPosition(x, y)) {
         return TILE_DEFAULT;
     }
-    return tiles[y * width + x];
+    return getPage(x, y).tiles[pageTileIndex(x, y)];
 }
 
 int Grid::getWidth() const { return width; }
 
 int Grid::getHeight() const { return height; }
 
+GridRegion Grid::getBounds() const { return {0, 0, width, height}; }
+
 void Grid::resize(int newWidth, int newHeight) {
     if (newWidth == width && newHeight == height) {
         return;
     }
 
-    std::vector<GridTile> newTiles(newWidth * newHeight, TILE_DEFAULT);
+    int newPageCountX = pageCountFor(newWidth);
+    int newPageCountY = pageCountFor(newHeight);
 
-    // Copy existing tiles that fit in new dimensions
-    int copyWidth = std::min(width, newWidth);
-    int copyHeight = std::min(height, newHeight);
+    // Only the page table is rebuilt, pages that survive the resize are shared rather than copied,
+    // as are whole rows if the width in pages is unchanged
+    auto newPageTable = createPageTable(newPageCountX, newPageCountY);
 
-    for (int y = 0; y < copyHeight; ++y) {
-        for (int x = 0; x < copyWidth; ++x) {
-            newTiles[y * newWidth + x] = tiles[y * width + x];
+    int copyPagesX = std::min(pageCountX, newPageCountX);
+    int copyPagesY = std::min(pageCountY, newPageCountY);
+
+    for (int pageY = 0; pageY < copyPagesY; ++pageY) {
+        const auto& row = (*pageTable)[pageY];
+
+        if (newPageCountX == pageCountX) {
+            (*newPageTable)[pageY] = row;
+            continue;
         }
+
+        auto& newRow = *(*newPageTable)[pageY];
+        std::copy_n(row->begin(), copyPagesX, newRow.begin());
     }
 
-    tiles = std::move(newTiles);
+    pageTable = std::move(newPageTable);
+    pageCountX = newPageCountX;
+    pageCountY = newPageCountY;
+
+    bool shrunk = newWidth < width || newHeight < height;
     width = newWidth;
     height = newHeight;
+
+    // Edge pages may now hang over the new bounds, keep the cells outside of the grid empty
+    if (shrunk) {
+        for (int pageY = 0; pageY < pageCountY; ++pageY) {
+            clearPageOutsideBounds(pageCountX - 1, pageY);
+        }
+        for (int pageX = 0; pageX < pageCountX; ++pageX) {
+            clearPageOutsideBounds(pageX, pageCountY - 1);
+        }
+    }
+
+    rebuildWalkability();
     markAllDirty();
+    version++;
+}
+
+int Grid::getChunkCountX() const { return chunkCountX; }
+
+int Grid::getChunkCountY() const { return chunkCountY; }
+
+Grid::DirtyConsumerId Grid::registerDirtyConsumer() {
+    auto it = std::find_if(dirtyTrackers.begin(), dirtyTrackers.end(),
+                           [](const DirtyTracker& tracker) { return !tracker.active; });
+
+    if (it == dirtyTrackers.end()) {
+        it = dirtyTrackers.emplace(dirtyTrackers.end());
+    }
+
+    it->active = true;
+    resetDirtyTracker(*it);
+
+    return static_cast<DirtyConsumerId>(it - dirtyTrackers.begin());
+}
+
+void Grid::unregisterDirtyConsumer(DirtyConsumerId consumer) {
+    if (consumer >= dirtyTrackers.size()) {
+        return;
+    }
+
+    dirtyTrackers[consumer] = {};
 }
 
-bool Grid::isDirty() const { return dirty; }
+bool Grid::isDirty(DirtyConsumerId consumer) const {
+    return consumer < dirtyTrackers.size() && !dirtyTrackers[consumer].dirty.empty();
+}
 
-GridRegion Grid::getDirtyRegion() const { return dirtyRegion; }
+void Grid::forEachDirtyChunk(DirtyConsumerId consumer,
+                             std::function<void(int chunkX, int chunkY)> callback) const {
+    if (consumer >= dirtyTrackers.size()) {
+        return;
+    }
 
-void Grid::clearDirty() {
-    dirty = false;
-    dirtyRegion = {0, 0, 0, 0};
+    for (auto index : dirtyTrackers[consumer].dirty) {
+        callback(index % chunkCountX, index / chunkCountX);
+    }
 }
 
-void Grid::markAllDirty() {
-    dirty = true;
-    dirtyRegion = {0, 0, width, height};
+void Grid::consumeDirtyChunks(DirtyConsumerId consumer,
+                              std::function<void(int chunkX, int chunkY)> callback) {
+    forEachDirtyChunk(consumer, callback);
+    clearDirty(consumer);
 }
 
-void Grid::forEachTile(std::function<void(int x, int y, const GridTile&)> callback) const {
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            callback(x, y, tiles[y * width + x]);
+void Grid::clearDirty(DirtyConsumerId consumer) {
+    if (consumer >= dirtyTrackers.size()) {
+        return;
+    }
+
+    auto& tracker = dirtyTrackers[consumer];
+
+    // Only clear the words we know are set, keeps scattered edits proportional to chunks touched
+    for (auto index : tracker.dirty) {
+        tracker.bits[index / 64] = 0;
+    }
+    tracker.dirty.clear();
+}
+
+void Grid::markAllDirty() {
+    chunkCountX = chunkCountFor(width);
+    chunkCountY = chunkCountFor(height);
+
+    for (auto& tracker : dirtyTrackers) {
+        if (tracker.active) {
+            resetDirtyTracker(tracker);
         }
     }
 }
 
-void Grid::expandDirtyRegion(int x, int y) {
-    if (!dirty) {
-        dirty = true;
-        dirtyRegion = {x, y, 1, 1};
-    } else {
-        int minX = std::min(dirtyRegion.x, x);
-        int minY = std::min(dirtyRegion.y, y);
-        int maxX = std::max(dirtyRegion.x + dirtyRegion.width, x + 1);
-        int maxY = std::max(dirtyRegion.y + dirtyRegion.height, y + 1);
+std::span<const GridTile> Grid::getRowSpan(int x, int y) const {
+    if (!isValidPosition(x, y)) {
+        return {};
+    }
+
+    int length = std::min(width, (x / PAGE_SIZE + 1) * PAGE_SIZE) - x;
+    return std::span<const GridTile>(&getPage(x, y).tiles[pageTileIndex(x, y)], length);
+}
+
+const WalkabilityBitmap& Grid::getWalkability() const { return walkability; }
 
-        dirtyRegion.x = minX;
-        dirtyRegion.y = minY;
-        dirtyRegion.width = maxX - minX;
-        dirtyRegion.height = maxY - minY;
+bool Grid::isWalkable(int x, int y) const { return walkability.isWalkable(x, y); }
+
+void Grid::updateRegions() const {
+    if (!regions.isUpToDate()) {
+        regions.update(walkability);
     }
 }
 
-bool Grid::isValidPosition(int x, int y) const {
-    return x >= 0 && x < width && y >= 0 && y < height;
+int32_t Grid::getRegion(int x, int y) const {
+    updateRegions();
+    return regions.getRegion(x, y);
 }
 
-std::vector<glm::ivec2> Grid::getIntersections(const glm::vec2& p1, const glm::vec2& p2) {
-    std::vector<glm::ivec2> intersections;
+bool Grid::isReachable(const glm::ivec2& from, const glm::ivec2& to) const {
+    int32_t region = getRegion(from.x, from.y);
+    return region != WalkableRegions::NO_REGION && region == getRegion(to.x, to.y);
+}
+
+size_t Grid::getRegionCount() const {
+    updateRegions();
+    return regions.getRegionCount();
+}
 
-    // Offset so we get the center of the tile
-    auto op1 = p1 + glm::vec2(.5f, .5f);
-    auto op2 = p2 + glm::vec2(.5f, .5f);
+std::shared_ptr<const GridSnapshot> Grid::createSnapshot() {
+    auto snapshot = lastSnapshot.lock();
 
-    int xMin = std::max(0, (int) std::floor(std::min(op1.x, op2.x)));
-    int xMax = std::min(getWidth(), (int) std::ceil(std::max(op1.x, op2.x)));
-    int yMin = std::max(0, (int) std::floor(std::min(op1.y, op2.y)));
-    int yMax = std::min(getHeight(), (int) std::ceil(std::max(op1.y, op2.y)));
+    if (!snapshot || snapshot->getVersion() != version) {
+        snapshot = std::make_shared<const GridSnapshot>(version, width, height, pageTable);
+        lastSnapshot = snapshot;
+    }
+
+    return snapshot;
+}
+
+uint64_t Grid::getVersion() const { return version; }
+
+int Grid::getPageCountX() const { return pageCountX; }
+
+int Grid::getPageCountY() const { return pageCountY; }
+
+size_t Grid::getAllocatedPageCount() const {
+    size_t count = 0;
+
+    for (const auto& row : *pageTable) {
+        count += std::count_if(row->begin(), row->end(),
+                               [this](const auto& page) { return !isEmptyPage(page); });
+    }
+
+    return count;
+}
+
+void Grid::forEachPage(
+    std::function<void(int pageX, int pageY, const TilePage&)> callback) const {
+    for (int pageY = 0; pageY < pageCountY; ++pageY) {
+        for (int pageX = 0; pageX < pageCountX; ++pageX) {
+            const auto& page = getPageSlot(pageX, pageY);
 
-    for (int x = xMin; x < xMax; x++) {
-        for (int y = yMin; y < yMax; y++) {
-            if (hasTileIntersection(op1, op2, x, y)) {
-                intersections.push_back(glm::ivec2(x, y));
+            if (!isEmptyPage(page)) {
+                callback(pageX, pageY, *page);
             }
         }
     }
+}
 
-    return intersections;
+const std::shared_ptr<Grid::TilePage>& Grid::getEmptyPage() {
+    static const std::shared_ptr<TilePage> emptyPage = [] {
+        auto page = std::make_shared<TilePage>();
+        page->tiles.fill(TILE_DEFAULT);
+        return page;
+    }();
+
+    return emptyPage;
+}
+
+std::shared_ptr<Grid::PageTable> Grid::createPageTable(int pageCountX, int pageCountY) {
+    auto table = std::make_shared<PageTable>(pageCountY);
+
+    for (auto& row : *table) {
+        row = std::make_shared<PageRow>(pageCountX, getEmptyPage());
+    }
+
+    return table;
 }
 
-bool Grid::hasTileIntersection(const glm::vec2& p1, const glm::vec2& p2, int x, int y) {
-    std::vector<glm::vec2> corners = {glm::vec2(x, y), glm::vec2(x, y + 1), glm::vec2(x + 1, y),
-                                      glm::vec2(x + 1, y + 1)};
+bool Grid::isEmptyPage(const std::shared_ptr<TilePage>& page) const {
+    return page == getEmptyPage();
+}
+
+const std::shared_ptr<Grid::TilePage>& Grid::getPageSlot(int pageX, int pageY) const {
+    return (*(*pageTable)[pageY])[pageX];
+}
+
+const Grid::TilePage& Grid::getPage(int x, int y) const {
+    return *getPageSlot(x / PAGE_SIZE, y / PAGE_SIZE);
+}
+
+Grid::TilePage& Grid::getWritablePage(int x, int y) {
+    // Anything still held by a snapshot is copied first, from the table down to the page. Only
+    // this thread hands out references, so the counts can drop under us but never rise
+    if (pageTable.use_count() > 1) {
+        pageTable = std::make_shared<PageTable>(*pageTable);
+    }
+
+    auto& row = (*pageTable)[y / PAGE_SIZE];
+    if (row.use_count() > 1) {
+        row = std::make_shared<PageRow>(*row);
+    }
+
+    auto& page = (*row)[x / PAGE_SIZE];
 
-    if (!hasPointsOnDifferentSides(p1, p2, corners)) {
-        return false;
-    } else if (p1.x > corners[3].x && p2.x > corners[3].x) {
-        return false;
-    } else if (p1.x < corners[0].x && p2.x < corners[0].x) {
-        return false;
-    } else if (p1.y > corners[3].y && p2.y > corners[3].y) {
-        return false;
-    } else if (p1.y < corners[0].y && p2.y < corners[0].y) {
-        return false;
+    if (isEmptyPage(page)) {
+        page = std::make_shared<TilePage>(*getEmptyPage());
+    } else if (page.use_count() > 1) {
+        page = std::make_shared<TilePage>(*page);
     }
 
-    return true;
+    return *page;
+}
+
+void Grid::clearPageOutsideBounds(int pageX, int pageY) {
+    if (pageX < 0 || pageY < 0 || isEmptyPage(getPageSlot(pageX, pageY))) {
+        return;
+    }
+
+    auto& page = getWritablePage(pageX * PAGE_SIZE, pageY * PAGE_SIZE);
+
+    for (int localY = 0; localY < PAGE_SIZE; ++localY) {
+        for (int localX = 0; localX < PAGE_SIZE; ++localX) {
+            int x = pageX * PAGE_SIZE + localX;
+            int y = pageY * PAGE_SIZE + localY;
+
+            if (x >= width || y >= height) {
+                page.tiles[localY * PAGE_SIZE + localX] = TILE_DEFAULT;
+            }
+        }
+    }
 }
 
-bool Grid::hasPointsOnDifferentSides(const glm::vec2& p1, const glm::vec2& p2,
-                                     const std::vector<glm::vec2>& corners) {
-    float p = pointOnLineSide(p1, p2, corners[0]);
+void Grid::markChunkDirty(int x, int y) {
+    uint32_t index = (y / CHUNK_SIZE) * chunkCountX + (x / CHUNK_SIZE);
+    uint64_t mask = uint64_t(1) << (index % 64);
 
-    for (int i = 1; i < 4; i++) {
-        p *= pointOnLineSide(p1, p2, corners[i]);
-        if (p < 0) {
-            return true;
+    for (auto& tracker : dirtyTrackers) {
+        if (tracker.active && !(tracker.bits[index / 64] & mask)) {
+            tracker.bits[index / 64] |= mask;
+            tracker.dirty.push_back(index);
         }
     }
+}
+
+void Grid::resetDirtyTracker(DirtyTracker& tracker) {
+    uint32_t chunkCount = chunkCountX * chunkCountY;
+
+    tracker.bits.assign((chunkCount + 63) / 64, 0);
+    tracker.dirty.resize(chunkCount);
+
+    for (uint32_t index = 0; index < chunkCount; ++index) {
+        tracker.bits[index / 64] |= uint64_t(1) << (index % 64);
+        tracker.dirty[index] = index;
+    }
+}
+
+void Grid::rebuildWalkability() {
+    walkability.resize(width, height);
+
+    forEachPage([this](int pageX, int pageY, const TilePage& page) {
+        int endX = std::min(PAGE_SIZE, width - pageX * PAGE_SIZE);
+        int endY = std::min(PAGE_SIZE, height - pageY * PAGE_SIZE);
+
+        for (int localY = 0; localY < endY; ++localY) {
+            for (int localX = 0; localX < endX; ++localX) {
+                if (page.tiles[localY * PAGE_SIZE + localX].walkable == GridTile::WALKABLE) {
+                    walkability.setWalkable(pageX * PAGE_SIZE + localX, pageY * PAGE_SIZE + localY,
+                                            true);
+                }
+            }
+        }
+    });
+
+    regions.invalidate();
+}
 
-    return false;
+bool Grid::isValidPosition(int x, int y) const {
+    return x >= 0 && x < width && y >= 0 && y < height;
 }
 
-float Grid::pointOnLineSide(const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& point) {
-    return ((p2.y - p1.y) * point.x) + ((p1.x - p2.x) * point.y) + (p2.x * p1.y - p1.x * p2.y);
+std::vector<glm::ivec2> Grid::getIntersections(const glm::vec2& p1, const glm::vec2& p2) const {
+    std::vector<glm::ivec2> intersections;
+
+    traverseGrid(p1, p2, TraversalMode::THIN, [&](int x, int y) {
+        if (isValidPosition(x, y)) {
+            intersections.push_back(glm::ivec2(x, y));
+        }
+    });
+
+    return intersections;
 }
 
 }  // namespace SpaceRogueLite
@@ -0,0 +1,579 @@
+#include "griddelta.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstring>
+#include <utility>
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr int CHUNK_TILES = Grid::CHUNK_SIZE * Grid::CHUNK_SIZE;
+
+// Field widths, in bits
+constexpr int CHUNK_COORD_BITS = 16;
+constexpr int PALETTE_SIZE_BITS = 8;  // Stored as size - 1
+constexpr int RUN_COUNT_BITS = 8;     // Stored as count - 1
+constexpr int RUN_LENGTH_BITS = 8;    // Stored as length - 1
+constexpr int CELL_COUNT_BITS = 8;    // Stored as count - 1
+constexpr int CELL_POSITION_BITS = 8;
+constexpr int TILE_ID_BITS = 16;
+constexpr int TILE_VARIANT_BITS = 16;
+constexpr int TILE_WALKABLE_BITS = 1;
+constexpr int TILE_ORIENTATION_BITS = 2;
+constexpr int TILE_BITS = TILE_ID_BITS + TILE_VARIANT_BITS + TILE_WALKABLE_BITS +
+                          TILE_ORIENTATION_BITS;
+
+static_assert(CHUNK_TILES <= (1 << PALETTE_SIZE_BITS) && CHUNK_TILES <= (1 << RUN_LENGTH_BITS) &&
+              CHUNK_TILES <= (1 << RUN_COUNT_BITS) && CHUNK_TILES <= (1 << CELL_COUNT_BITS) &&
+              CHUNK_TILES <= (1 << CELL_POSITION_BITS));
+
+// A chunk of all different tiles: coordinates, encoding, full palette, packed flag and an 8 bit
+// index per tile. Changed tiles are only sent when smaller
+static_assert(GridDelta::MAX_CHUNK_BYTES ==
+              (2 * CHUNK_COORD_BITS + 1 + PALETTE_SIZE_BITS + CHUNK_TILES * TILE_BITS + 1 +
+               CHUNK_TILES * 8 + 7) / 8);
+
+// The smallest chunk either encoding can produce: coordinates, encoding, a palette of one tile and
+// the packed flag or cell count that follows it
+constexpr size_t MIN_CHUNK_BITS = 2 * CHUNK_COORD_BITS + 1 + PALETTE_SIZE_BITS + TILE_BITS + 1;
+
+// Byte aligned header: flags (uint8), width (int32), height (int32), chunk count (uint16)
+constexpr uint8_t FLAG_RESET = 1 << 0;
+constexpr int MAX_DIMENSION = 1 << 16;
+constexpr size_t MAX_CHUNKS_PER_DELTA = 0xFFFF;
+
+enum class ChunkEncoding : uint8_t { ALL_TILES, CHANGED_TILES };
+
+class BitWriter {
+public:
+    void write(uint32_t value, int bits) {
+        for (int written = 0; written < bits;) {
+            const int offset = static_cast<int>(bitCount % 8);
+            if (offset == 0) {
+                bytes.push_back(0);
+            }
+
+            const int count = std::min(bits - written, 8 - offset);
+            bytes.back() |= static_cast<uint8_t>(((value >> written) & ((1u << count) - 1))
+                                                 << offset);
+            written += count;
+            bitCount += count;
+        }
+    }
+
+    // Drops everything written after bitCount
+    void truncate(size_t newBitCount) {
+        bitCount = newBitCount;
+        bytes.resize((bitCount + 7) / 8);
+
+        if (bitCount % 8 != 0) {
+            bytes.back() &= static_cast<uint8_t>((1u << (bitCount % 8)) - 1);
+        }
+    }
+
+    void append(const BitWriter& other) {
+        for (size_t bit = 0; bit < other.bitCount; bit += 8) {
+            const int count = static_cast<int>(std::min<size_t>(8, other.bitCount - bit));
+            write(other.bytes[bit / 8], count);
+        }
+    }
+
+    size_t getBitCount(void) const { return bitCount; }
+    size_t getByteCount(void) const { return bytes.size(); }
+    const std::vector<uint8_t>& getBytes(void) const { return bytes; }
+
+private:
+    std::vector<uint8_t> bytes;
+    size_t bitCount = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(std::span<const uint8_t> bytes) : bytes(bytes) {}
+
+    bool read(int bits, uint32_t& value) {
+        if (bitCount + bits > bytes.size() * 8) {
+            return false;
+        }
+
+        value = 0;
+        for (int read = 0; read < bits;) {
+            const int offset = static_cast<int>(bitCount % 8);
+            const int count = std::min(bits - read, 8 - offset);
+
+            value |= ((uint32_t(bytes[bitCount / 8]) >> offset) & ((1u << count) - 1)) << read;
+            read += count;
+            bitCount += count;
+        }
+
+        return true;
+    }
+
+private:
+    std::span<const uint8_t> bytes;
+    size_t bitCount = 0;
+};
+
+struct DecodedChunk {
+    int chunkX;
+    int chunkY;
+    std::array<GridTile, CHUNK_TILES> tiles;  // Row-major over the chunk's in-bounds tiles
+    std::bitset<CHUNK_TILES> isWritten;
+};
+
+int getIndexBits(size_t paletteSize) {
+    return std::bit_width(static_cast<uint32_t>(paletteSize - 1));
+}
+
+void writeTile(BitWriter& writer, const GridTile& tile) {
+    writer.write(tile.id, TILE_ID_BITS);
+    writer.write(tile.variant, TILE_VARIANT_BITS);
+    writer.write(tile.walkable == GridTile::WALKABLE ? 0 : 1, TILE_WALKABLE_BITS);
+    writer.write(tile.orientation, TILE_ORIENTATION_BITS);
+}
+
+bool readTile(BitReader& reader, GridTile& tile) {
+    uint32_t id, variant, walkable, orientation;
+
+    if (!reader.read(TILE_ID_BITS, id) || !reader.read(TILE_VARIANT_BITS, variant) ||
+        !reader.read(TILE_WALKABLE_BITS, walkable) ||
+        !reader.read(TILE_ORIENTATION_BITS, orientation)) {
+        return false;
+    }
+
+    tile = {static_cast<TileId>(id), static_cast<TileVariantId>(variant),
+            walkable == 0 ? GridTile::WALKABLE : GridTile::BLOCKED,
+            static_cast<uint8_t>(orientation)};
+    return true;
+}
+
+GridRegion getChunkRegion(int chunkX, int chunkY, int width, int height) {
+    const int x = chunkX * Grid::CHUNK_SIZE;
+    const int y = chunkY * Grid::CHUNK_SIZE;
+
+    return {x, y, std::min(Grid::CHUNK_SIZE, width - x), std::min(Grid::CHUNK_SIZE, height - y)};
+}
+
+size_t readChunkTiles(const GridSnapshot& snapshot, const GridRegion& region,
+                      std::array<GridTile, CHUNK_TILES>& tiles) {
+    size_t tileCount = 0;
+
+    snapshot.forEachRowSpan(region, [&](int x, int y, std::span<const GridTile> row) {
+        std::copy(row.begin(), row.end(), tiles.begin() + tileCount);
+        tileCount += row.size();
+    });
+
+    return tileCount;
+}
+
+// Chunks are small enough that a linear palette search beats hashing
+uint8_t getPaletteIndex(std::vector<GridTile>& palette, const GridTile& tile) {
+    auto entry = std::find(palette.begin(), palette.end(), tile);
+    if (entry == palette.end()) {
+        entry = palette.insert(palette.end(), tile);
+    }
+
+    return static_cast<uint8_t>(entry - palette.begin());
+}
+
+void writePalette(BitWriter& writer, const std::vector<GridTile>& palette) {
+    writer.write(static_cast<uint32_t>(palette.size() - 1), PALETTE_SIZE_BITS);
+
+    for (const auto& tile : palette) {
+        writeTile(writer, tile);
+    }
+}
+
+bool readPalette(BitReader& reader, std::array<GridTile, CHUNK_TILES>& palette,
+                 uint32_t& paletteSize) {
+    if (!reader.read(PALETTE_SIZE_BITS, paletteSize)) {
+        return false;
+    }
+
+    paletteSize++;
+
+    for (uint32_t i = 0; i < paletteSize; i++) {
+        if (!readTile(reader, palette[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Every tile of the chunk, as runs or packed indices
+void writeAllTiles(BitWriter& writer, const GridTile* tiles, size_t tileCount) {
+    std::vector<GridTile> palette;
+    std::array<uint8_t, CHUNK_TILES> indices;
+    size_t runCount = 0;
+
+    for (size_t i = 0; i < tileCount; i++) {
+        indices[i] = getPaletteIndex(palette, tiles[i]);
+        runCount += i == 0 || indices[i] != indices[i - 1];
+    }
+
+    const int indexBits = getIndexBits(palette.size());
+    const size_t packedBits = tileCount * indexBits;
+    const size_t runBits = RUN_COUNT_BITS + runCount * (indexBits + RUN_LENGTH_BITS);
+    const bool isPacked = packedBits <= runBits;
+
+    writePalette(writer, palette);
+    writer.write(isPacked ? 1 : 0, 1);
+
+    if (isPacked) {
+        for (size_t i = 0; i < tileCount; i++) {
+            writer.write(indices[i], indexBits);
+        }
+        return;
+    }
+
+    writer.write(static_cast<uint32_t>(runCount - 1), RUN_COUNT_BITS);
+
+    for (size_t start = 0; start < tileCount;) {
+        size_t end = start + 1;
+        while (end < tileCount && indices[end] == indices[start]) {
+            end++;
+        }
+
+        writer.write(indices[start], indexBits);
+        writer.write(static_cast<uint32_t>(end - start - 1), RUN_LENGTH_BITS);
+        start = end;
+    }
+}
+
+bool readAllTiles(BitReader& reader, size_t tileCount, DecodedChunk& chunk) {
+    std::array<GridTile, CHUNK_TILES> palette;
+    uint32_t paletteSize, isPacked;
+
+    if (!readPalette(reader, palette, paletteSize) || !reader.read(1, isPacked)) {
+        return false;
+    }
+
+    const int indexBits = getIndexBits(paletteSize);
+
+    if (isPacked) {
+        for (size_t i = 0; i < tileCount; i++) {
+            uint32_t index;
+            if (!reader.read(indexBits, index) || index >= paletteSize) {
+                return false;
+            }
+
+            chunk.tiles[i] = palette[index];
+        }
+    } else {
+        uint32_t runCount;
+        if (!reader.read(RUN_COUNT_BITS, runCount)) {
+            return false;
+        }
+
+        runCount++;
+        size_t tileIndex = 0;
+
+        for (uint32_t run = 0; run < runCount; run++) {
+            uint32_t index, length;
+            if (!reader.read(indexBits, index) || !reader.read(RUN_LENGTH_BITS, length) ||
+                index >= paletteSize || tileIndex + length + 1 > tileCount) {
+                return false;
+            }
+
+            std::fill_n(chunk.tiles.begin() + tileIndex, length + 1, palette[index]);
+            tileIndex += length + 1;
+        }
+
+        if (tileIndex != tileCount) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < tileCount; i++) {
+        chunk.isWritten.set(i);
+    }
+
+    return true;
+}
+
+// Only the tiles which differ from the previous tiles, as (position, palette index) pairs
+void writeChangedTiles(BitWriter& writer, const GridTile* tiles, const GridTile* previousTiles,
+                       size_t tileCount) {
+    std::vector<GridTile> palette;
+    std::vector<std::pair<uint8_t, uint8_t>> cells;
+
+    for (size_t i = 0; i < tileCount; i++) {
+        if (tiles[i] != previousTiles[i]) {
+            cells.emplace_back(static_cast<uint8_t>(i), getPaletteIndex(palette, tiles[i]));
+        }
+    }
+
+    const int indexBits = getIndexBits(palette.size());
+
+    writePalette(writer, palette);
+    writer.write(static_cast<uint32_t>(cells.size() - 1), CELL_COUNT_BITS);
+
+    for (const auto& [position, index] : cells) {
+        writer.write(position, CELL_POSITION_BITS);
+        writer.write(index, indexBits);
+    }
+}
+
+bool readChangedTiles(BitReader& reader, size_t tileCount, DecodedChunk& chunk) {
+    std::array<GridTile, CHUNK_TILES> palette;
+    uint32_t paletteSize, cellCount;
+
+    if (!readPalette(reader, palette, paletteSize) || !reader.read(CELL_COUNT_BITS, cellCount)) {
+        return false;
+    }
+
+    const int indexBits = getIndexBits(paletteSize);
+
+    for (uint32_t cell = 0; cell <= cellCount; cell++) {
+        uint32_t position, index;
+        if (!reader.read(CELL_POSITION_BITS, position) || !reader.read(indexBits, index) ||
+            position >= tileCount || index >= paletteSize) {
+            return false;
+        }
+
+        chunk.tiles[position] = palette[index];
+        chunk.isWritten.set(position);
+    }
+
+    return true;
+}
+
+// With a previous snapshot of the same size only changed tiles are sent, if that's smaller
+void writeChunk(BitWriter& writer, const GridSnapshot& current, const GridSnapshot* previous,
+                int chunkX, int chunkY) {
+    const GridRegion region =
+        getChunkRegion(chunkX, chunkY, current.getWidth(), current.getHeight());
+
+    std::array<GridTile, CHUNK_TILES> tiles;
+    const size_t tileCount = readChunkTiles(current, region, tiles);
+
+    BitWriter allTiles;
+    writeAllTiles(allTiles, tiles.data(), tileCount);
+
+    BitWriter changedTiles;
+    if (previous != nullptr) {
+        std::array<GridTile, CHUNK_TILES> previousTiles;
+        readChunkTiles(*previous, region, previousTiles);
+
+        if (!std::equal(tiles.begin(), tiles.begin() + tileCount, previousTiles.begin())) {
+            writeChangedTiles(changedTiles, tiles.data(), previousTiles.data(), tileCount);
+        }
+    }
+
+    const bool isChangedOnly =
+        changedTiles.getBitCount() > 0 && changedTiles.getBitCount() < allTiles.getBitCount();
+
+    writer.write(chunkX, CHUNK_COORD_BITS);
+    writer.write(chunkY, CHUNK_COORD_BITS);
+    writer.write(static_cast<uint32_t>(isChangedOnly ? ChunkEncoding::CHANGED_TILES
+                                                     : ChunkEncoding::ALL_TILES),
+                 1);
+    writer.append(isChangedOnly ? changedTiles : allTiles);
+}
+
+bool readChunk(BitReader& reader, int width, int height, DecodedChunk& chunk) {
+    uint32_t chunkX, chunkY, encoding;
+
+    if (!reader.read(CHUNK_COORD_BITS, chunkX) || !reader.read(CHUNK_COORD_BITS, chunkY) ||
+        !reader.read(1, encoding)) {
+        return false;
+    }
+
+    chunk.chunkX = static_cast<int>(chunkX);
+    chunk.chunkY = static_cast<int>(chunkY);
+    chunk.isWritten.reset();
+
+    if (chunk.chunkX * Grid::CHUNK_SIZE >= width || chunk.chunkY * Grid::CHUNK_SIZE >= height) {
+        return false;
+    }
+
+    const GridRegion region = getChunkRegion(chunk.chunkX, chunk.chunkY, width, height);
+    const size_t tileCount = size_t(region.width) * region.height;
+
+    if (static_cast<ChunkEncoding>(encoding) == ChunkEncoding::CHANGED_TILES) {
+        return readChangedTiles(reader, tileCount, chunk);
+    }
+
+    return readAllTiles(reader, tileCount, chunk);
+}
+
+void writeHeader(std::vector<uint8_t>& bytes, uint8_t flags, int32_t width, int32_t height,
+                 uint16_t chunkCount) {
+    bytes.resize(GridDelta::HEADER_BYTES);
+    bytes[0] = flags;
+    std::memcpy(bytes.data() + 1, &width, sizeof(width));
+    std::memcpy(bytes.data() + 5, &height, sizeof(height));
+    std::memcpy(bytes.data() + 9, &chunkCount, sizeof(chunkCount));
+}
+
+std::vector<std::vector<uint8_t>> encodeDeltas(const GridSnapshot& current,
+                                               const GridSnapshot* previous,
+                                               const std::vector<glm::ivec2>& chunks, bool isReset,
+                                               size_t maxBytes) {
+    std::vector<std::vector<uint8_t>> deltas;
+    BitWriter writer;
+    size_t chunkCount = 0;
+
+    auto finishDelta = [&]() {
+        std::vector<uint8_t> delta;
+        writeHeader(delta, isReset && deltas.empty() ? FLAG_RESET : 0, current.getWidth(),
+                    current.getHeight(), static_cast<uint16_t>(chunkCount));
+        delta.insert(delta.end(), writer.getBytes().begin(), writer.getBytes().end());
+
+        deltas.push_back(std::move(delta));
+        writer = BitWriter();
+        chunkCount = 0;
+    };
+
+    for (const auto& chunk : chunks) {
+        const size_t start = writer.getBitCount();
+        writeChunk(writer, current, previous, chunk.x, chunk.y);
+
+        // Chunks only go into a fresh delta if they'd push this one over budget
+        if (chunkCount > 0 && (GridDelta::HEADER_BYTES + writer.getByteCount() > maxBytes ||
+                               chunkCount == MAX_CHUNKS_PER_DELTA)) {
+            writer.truncate(start);
+            finishDelta();
+            writeChunk(writer, current, previous, chunk.x, chunk.y);
+        }
+
+        chunkCount++;
+    }
+
+    // Resizes and resets still need sending when there are no chunks
+    if (chunkCount > 0 || deltas.empty()) {
+        finishDelta();
+    }
+
+    return deltas;
+}
+
+}  // namespace
+
+std::vector<std::vector<uint8_t>> GridDelta::encode(const GridSnapshot& current,
+                                                    const GridSnapshot* previous,
+                                                    size_t maxBytes) {
+    std::vector<glm::ivec2> chunks;
+
+    if (previous != nullptr) {
+        if (previous == &current) {
+            return {};
+        }
+
+        current.forEachChangedChunk(*previous, [&chunks](int chunkX, int chunkY) {
+            chunks.emplace_back(chunkX, chunkY);
+        });
+
+        const bool isResized = previous->getWidth() != current.getWidth() ||
+                               previous->getHeight() != current.getHeight();
+
+        if (chunks.empty() && !isResized) {
+            return {};
+        }
+
+        // After a resize the receiver's tiles no longer line up with the previous snapshot
+        return encodeDeltas(current, isResized ? nullptr : previous, chunks, false, maxBytes);
+    }
+
+    // The receiver starts from a cleared grid, so chunks which are still empty can be left out
+    const int chunkCountX = (current.getWidth() + Grid::CHUNK_SIZE - 1) / Grid::CHUNK_SIZE;
+    const int chunkCountY = (current.getHeight() + Grid::CHUNK_SIZE - 1) / Grid::CHUNK_SIZE;
+
+    for (int chunkY = 0; chunkY < chunkCountY; chunkY++) {
+        for (int chunkX = 0; chunkX < chunkCountX; chunkX++) {
+            bool isEmpty = true;
+
+            current.forEachRowSpan(
+                getChunkRegion(chunkX, chunkY, current.getWidth(), current.getHeight()),
+                [&isEmpty](int x, int y, std::span<const GridTile> tiles) {
+                    isEmpty = isEmpty && std::all_of(tiles.begin(), tiles.end(),
+                                                     [](const GridTile& tile) {
+                                                         return tile == TILE_DEFAULT;
+                                                     });
+                });
+
+            if (!isEmpty) {
+                chunks.emplace_back(chunkX, chunkY);
+            }
+        }
+    }
+
+    return encodeChunks(current, chunks, true, maxBytes);
+}
+
+std::vector<std::vector<uint8_t>> GridDelta::encodeChunks(const GridSnapshot& current,
+                                                          const std::vector<glm::ivec2>& chunks,
+                                                          bool isReset, size_t maxBytes) {
+    return encodeDeltas(current, nullptr, chunks, isReset, maxBytes);
+}
+
+bool GridDelta::isReset(std::span<const uint8_t> delta) {
+    return !delta.empty() && (delta[0] & FLAG_RESET);
+}
+
+bool GridDelta::apply(Grid& grid, std::span<const uint8_t> delta) {
+    if (delta.size() < HEADER_BYTES) {
+        return false;
+    }
+
+    const uint8_t flags = delta[0];
+    int32_t width, height;
+    uint16_t chunkCount;
+    std::memcpy(&width, delta.data() + 1, sizeof(width));
+    std::memcpy(&height, delta.data() + 5, sizeof(height));
+    std::memcpy(&chunkCount, delta.data() + 9, sizeof(chunkCount));
+
+    if (width < 0 || height < 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+        spdlog::warn("Grid delta has an invalid size {}x{}", width, height);
+        return false;
+    }
+
+    // The count comes off the wire, so it's checked against the payload before anything is
+    // allocated for it
+    const size_t payloadBits = (delta.size() - HEADER_BYTES) * 8;
+    if (chunkCount > payloadBits / MIN_CHUNK_BITS) {
+        spdlog::warn("Grid delta claims {} chunks but is only {} bytes", chunkCount, delta.size());
+        return false;
+    }
+
+    // Everything is decoded before the grid is touched, so a bad delta leaves the grid as it was
+    BitReader reader(delta.subspan(HEADER_BYTES));
+    std::vector<DecodedChunk> decodedChunks(chunkCount);
+
+    for (auto& chunk : decodedChunks) {
+        if (!readChunk(reader, width, height, chunk)) {
+            spdlog::warn("Grid delta is malformed");
+            return false;
+        }
+    }
+
+    if (flags & FLAG_RESET) {
+        const size_t pageCount = size_t((width + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE) *
+                                 ((height + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE);
+        grid.setPages(std::vector<std::shared_ptr<Grid::TilePage>>(pageCount), width, height);
+    } else {
+        grid.resize(width, height);
+    }
+
+    for (const auto& chunk : decodedChunks) {
+        const GridRegion region = getChunkRegion(chunk.chunkX, chunk.chunkY, width, height);
+        size_t index = 0;
+
+        for (int y = region.y; y < region.y + region.height; y++) {
+            for (int x = region.x; x < region.x + region.width; x++, index++) {
+                if (chunk.isWritten[index]) {
+                    grid.setTile(x, y, chunk.tiles[index]);
+                }
+            }
+        }
+    }
+
+    return true;
+}
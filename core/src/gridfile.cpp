@@ -0,0 +1,551 @@
+#include "gridfile.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "utils/threadpool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+// Fields are written as they sit in memory
+static_assert(std::endian::native == std::endian::little, "GridFile expects a little endian host");
+
+constexpr char MAGIC[4] = {'S', 'R', 'G', 'M'};
+
+struct Header {
+    char magic[4];
+    uint32_t formatVersion;
+    int32_t width;
+    int32_t height;
+    uint32_t pageSize;
+    uint32_t variantCount;
+    uint64_t variantTableOffset;
+    uint64_t pageIndexOffset;
+};
+
+static_assert(sizeof(Header) == 40);
+static_assert(Grid::PAGE_SIZE * Grid::PAGE_SIZE <= std::numeric_limits<uint16_t>::max());
+
+// Keeps corrupt headers from asking for absurd allocations
+constexpr int MAX_DIMENSION = 1 << 16;
+
+template <typename T>
+void append(std::vector<uint8_t>& buffer, const T& value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool read(const uint8_t* data, size_t size, uint64_t offset, T& value) {
+    if (offset > size || size - offset < sizeof(T)) {
+        return false;
+    }
+
+    std::memcpy(&value, data + offset, sizeof(T));
+    return true;
+}
+
+uint64_t getTileKey(const GridTile& tile) {
+    return uint64_t(tile.id) | (uint64_t(tile.variant) << 16) | (uint64_t(tile.walkable) << 32) |
+           (uint64_t(tile.orientation) << 40);
+}
+
+}  // namespace
+
+struct GridFile::Mapping {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE view = nullptr;
+
+    bool map(const std::string& path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return false;
+        }
+
+        view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (view == nullptr) {
+            return false;
+        }
+
+        data = static_cast<const uint8_t*>(MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0));
+        size = data != nullptr ? static_cast<size_t>(fileSize.QuadPart) : 0;
+        return data != nullptr;
+    }
+
+    void willNeed(void) {
+        WIN32_MEMORY_RANGE_ENTRY range = {const_cast<uint8_t*>(data), size};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+
+    ~Mapping() {
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (view != nullptr) {
+            CloseHandle(view);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+    }
+#else
+    bool map(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        void* address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (address == MAP_FAILED) {
+            return false;
+        }
+
+        data = static_cast<const uint8_t*>(address);
+        size = static_cast<size_t>(status.st_size);
+        return true;
+    }
+
+    // Reads the whole file ahead rather than faulting it in a page at a time
+    void willNeed(void) { madvise(const_cast<uint8_t*>(data), size, MADV_WILLNEED); }
+
+    ~Mapping() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+#endif
+};
+
+GridFile::GridFile() = default;
+
+GridFile::~GridFile() = default;
+
+bool GridFile::save(const std::string& path, const GridSnapshot& snapshot,
+                    const TileVariantTable& variantTable) {
+    const int width = snapshot.getWidth();
+    const int height = snapshot.getHeight();
+    const int pageCountX = (width + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE;
+    const int pageCountY = (height + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE;
+
+    static_assert(sizeof(EncodedRun) == 8);
+
+    std::vector<uint8_t> variants;
+    for (size_t variant = 0; variant < variantTable.size(); variant++) {
+        const auto& type = variantTable.getType(static_cast<TileVariantId>(variant));
+
+        if (type.size() > std::numeric_limits<uint16_t>::max()) {
+            spdlog::error("Tile variant name too long to save: {}", type);
+            return false;
+        }
+
+        append(variants, static_cast<uint16_t>(type.size()));
+        variants.insert(variants.end(), type.begin(), type.end());
+    }
+
+    std::vector<PageIndexEntry> index(size_t(pageCountX) * pageCountY, {0, 0, 0});
+    std::vector<uint8_t> payload;
+
+    for (int pageY = 0; pageY < pageCountY; pageY++) {
+        for (int pageX = 0; pageX < pageCountX; pageX++) {
+            GridRegion region = {pageX * Grid::PAGE_SIZE, pageY * Grid::PAGE_SIZE,
+                                 Grid::PAGE_SIZE, Grid::PAGE_SIZE};
+
+            const size_t start = payload.size();
+            uint32_t runCount = 0;
+            bool isEmpty = true;
+            EncodedRun run = {0, 0, 0, 0, 0};
+
+            snapshot.forEachRowSpan(region, [&](int x, int y, std::span<const GridTile> tiles) {
+                for (const auto& tile : tiles) {
+                    isEmpty = isEmpty && tile == TILE_DEFAULT;
+
+                    if (run.length > 0 && run.id == tile.id && run.variant == tile.variant &&
+                        run.walkable == tile.walkable && run.orientation == tile.orientation) {
+                        run.length++;
+                        continue;
+                    }
+
+                    if (run.length > 0) {
+                        append(payload, run);
+                        runCount++;
+                    }
+
+                    run = {1, tile.id, tile.variant, tile.walkable, tile.orientation};
+                }
+            });
+
+            if (isEmpty) {
+                payload.resize(start);
+                continue;
+            }
+
+            append(payload, run);
+            runCount++;
+
+            index[pageY * pageCountX + pageX] = {start, uint32_t(payload.size() - start),
+                                                 runCount};
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.formatVersion = FORMAT_VERSION;
+    header.width = width;
+    header.height = height;
+    header.pageSize = Grid::PAGE_SIZE;
+    header.variantCount = static_cast<uint32_t>(variantTable.size());
+    header.variantTableOffset = sizeof(Header);
+    header.pageIndexOffset = header.variantTableOffset + variants.size();
+
+    const uint64_t payloadOffset = header.pageIndexOffset + index.size() * sizeof(PageIndexEntry);
+    for (auto& entry : index) {
+        if (entry.size > 0) {
+            entry.offset += payloadOffset;
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        spdlog::error("Failed to open grid file {} for writing", path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(variants.data()), variants.size());
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(PageIndexEntry));
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    if (!file.good()) {
+        spdlog::error("Failed to write grid file {}", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool GridFile::open(const std::string& path, const TileVariantTable& variantTable) {
+    close();
+
+    mapping = std::make_unique<Mapping>();
+
+    if (!mapping->map(path)) {
+        spdlog::error("Failed to map grid file {}", path);
+        close();
+        return false;
+    }
+
+    if (!readHeader(variantTable)) {
+        spdlog::error("Invalid grid file {}", path);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void GridFile::close(void) {
+    // Decoded pages are owned copies, so any handed out stay valid after the file is unmapped
+    mapping.reset();
+    width = 0;
+    height = 0;
+    pageCountX = 0;
+    pageCountY = 0;
+    pageIndex.clear();
+    variantRemap.clear();
+    pages.clear();
+    isDecoded.clear();
+    decodedPageCount = 0;
+    uniformPages.clear();
+}
+
+bool GridFile::isOpen(void) const { return mapping != nullptr; }
+
+int GridFile::getWidth(void) const { return width; }
+
+int GridFile::getHeight(void) const { return height; }
+
+GridTile GridFile::getTile(int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        return TILE_DEFAULT;
+    }
+
+    auto page = getPage(x / Grid::PAGE_SIZE, y / Grid::PAGE_SIZE);
+
+    if (!page) {
+        return TILE_DEFAULT;
+    }
+
+    return page->tiles[(y % Grid::PAGE_SIZE) * Grid::PAGE_SIZE + (x % Grid::PAGE_SIZE)];
+}
+
+std::shared_ptr<Grid::TilePage> GridFile::getPage(int pageX, int pageY) {
+    if (pageX < 0 || pageY < 0 || pageX >= pageCountX || pageY >= pageCountY) {
+        return nullptr;
+    }
+
+    const size_t index = pageY * pageCountX + pageX;
+
+    if (!isDecoded[index]) {
+        pages[index] = decodePage(pageX, pageY);
+        isDecoded[index] = 1;
+        decodedPageCount++;
+    }
+
+    return pages[index];
+}
+
+bool GridFile::loadInto(Grid& grid) {
+    if (!isOpen()) {
+        return false;
+    }
+
+    mapping->willNeed();
+
+    // Uniform pages go through the shared uniformPages cache so are done here, the rest only read
+    // the mapping and are decoded in parallel
+    std::vector<size_t> pending;
+
+    for (int pageY = 0; pageY < pageCountY; pageY++) {
+        for (int pageX = 0; pageX < pageCountX; pageX++) {
+            const size_t index = pageY * pageCountX + pageX;
+            GridTile tile;
+
+            if (isDecoded[index]) {
+                continue;
+            }
+
+            if (pageIndex[index].size == 0 || isUniformPage(pageX, pageY, tile)) {
+                getPage(pageX, pageY);
+            } else {
+                pending.push_back(index);
+            }
+        }
+    }
+
+    Utils::getThreadPool().parallelFor(
+        pending.size(), PARALLEL_PAGE_COUNT, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const int pageX = static_cast<int>(pending[i] % pageCountX);
+                const int pageY = static_cast<int>(pending[i] / pageCountX);
+                pages[pending[i]] = decodeRuns(pageX, pageY);
+            }
+        });
+
+    // Handed over rather than shared, pages the file still held would be copied by the grid on
+    // their first write. Pages read after this are decoded again
+    grid.setPages(std::move(pages), width, height);
+
+    pages.assign(isDecoded.size(), nullptr);
+    isDecoded.assign(isDecoded.size(), 0);
+    decodedPageCount = 0;
+    uniformPages.clear();
+
+    return true;
+}
+
+size_t GridFile::getDecodedPageCount(void) const { return decodedPageCount; }
+
+bool GridFile::readHeader(const TileVariantTable& variantTable) {
+    const uint8_t* data = mapping->data;
+    const size_t size = mapping->size;
+
+    Header header;
+    if (!read(data, size, 0, header) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+
+    if (header.formatVersion != FORMAT_VERSION) {
+        spdlog::error("Unsupported grid file version {}, expected {}", header.formatVersion,
+                      FORMAT_VERSION);
+        return false;
+    }
+
+    if (header.pageSize != Grid::PAGE_SIZE || header.width < 0 || header.height < 0 ||
+        header.width > MAX_DIMENSION || header.height > MAX_DIMENSION) {
+        return false;
+    }
+
+    width = header.width;
+    height = header.height;
+    pageCountX = (width + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE;
+    pageCountY = (height + Grid::PAGE_SIZE - 1) / Grid::PAGE_SIZE;
+
+    // Variants missing from the loading table fall back to no variant
+    uint64_t offset = header.variantTableOffset;
+    size_t missingVariants = 0;
+    variantRemap.clear();
+
+    for (uint32_t variant = 0; variant < header.variantCount; variant++) {
+        uint16_t length;
+        if (!read(data, size, offset, length) || size - offset - sizeof(length) < length) {
+            return false;
+        }
+
+        std::string type(reinterpret_cast<const char*>(data + offset + sizeof(length)), length);
+        offset += sizeof(length) + length;
+
+        if (variant == TILE_VARIANT_NONE) {
+            variantRemap.push_back(TILE_VARIANT_NONE);
+            continue;
+        }
+
+        auto remapped = variantTable.find(type);
+        missingVariants += !remapped.has_value();
+        variantRemap.push_back(remapped.value_or(TILE_VARIANT_NONE));
+    }
+
+    if (missingVariants > 0) {
+        spdlog::warn("{} tile variants in the grid file are missing from the tile set",
+                     missingVariants);
+    }
+
+    const size_t pageCount = size_t(pageCountX) * pageCountY;
+    pageIndex.resize(pageCount);
+
+    for (size_t i = 0; i < pageCount; i++) {
+        auto& entry = pageIndex[i];
+
+        if (!read(data, size, header.pageIndexOffset + i * sizeof(PageIndexEntry), entry)) {
+            return false;
+        }
+
+        if (entry.size != uint64_t(entry.runCount) * sizeof(EncodedRun) ||
+            entry.offset > size || size - entry.offset < entry.size) {
+            return false;
+        }
+    }
+
+    pages.assign(pageCount, nullptr);
+    isDecoded.assign(pageCount, 0);
+    decodedPageCount = 0;
+    uniformPages.clear();
+
+    return true;
+}
+
+bool GridFile::isUniformPage(int pageX, int pageY, GridTile& tile) const {
+    const auto& entry = pageIndex[pageY * pageCountX + pageX];
+
+    if (entry.runCount != 1 || (pageX + 1) * Grid::PAGE_SIZE > width ||
+        (pageY + 1) * Grid::PAGE_SIZE > height) {
+        return false;
+    }
+
+    EncodedRun run;
+    std::memcpy(&run, mapping->data + entry.offset, sizeof(run));
+
+    if (run.length != Grid::PAGE_SIZE * Grid::PAGE_SIZE) {
+        return false;
+    }
+
+    tile = decodeTile(run);
+    return true;
+}
+
+std::shared_ptr<Grid::TilePage> GridFile::decodePage(int pageX, int pageY) {
+    if (pageIndex[pageY * pageCountX + pageX].size == 0) {
+        return nullptr;
+    }
+
+    GridTile tile;
+    if (isUniformPage(pageX, pageY, tile)) {
+        auto& page = uniformPages[getTileKey(tile)];
+
+        if (!page) {
+            page = std::make_shared<Grid::TilePage>();
+            page->tiles.fill(tile);
+        }
+
+        return page;
+    }
+
+    return decodeRuns(pageX, pageY);
+}
+
+std::shared_ptr<Grid::TilePage> GridFile::decodeRuns(int pageX, int pageY) const {
+    const auto& entry = pageIndex[pageY * pageCountX + pageX];
+    const int tilesX = std::min(Grid::PAGE_SIZE, width - pageX * Grid::PAGE_SIZE);
+    const int tilesY = std::min(Grid::PAGE_SIZE, height - pageY * Grid::PAGE_SIZE);
+    const int tileCount = tilesX * tilesY;
+    const uint8_t* runs = mapping->data + entry.offset;
+
+    // Tiles are constructed as TILE_DEFAULT, which covers anything outside of the grid bounds
+    auto page = std::make_shared<Grid::TilePage>();
+
+    GridTile* row = page->tiles.data();
+    int x = 0;
+    int tileIndex = 0;
+
+    for (uint32_t i = 0; i < entry.runCount; i++) {
+        EncodedRun run;
+        std::memcpy(&run, runs + i * sizeof(EncodedRun), sizeof(run));
+
+        GridTile tile = decodeTile(run);
+        int remaining = std::min<int>(run.length, tileCount - tileIndex);
+        tileIndex += remaining;
+
+        // Runs carry on across rows, fill a row segment at a time
+        while (remaining > 0) {
+            int count = std::min(remaining, tilesX - x);
+            std::fill_n(row + x, count, tile);
+            remaining -= count;
+            x += count;
+
+            if (x == tilesX) {
+                x = 0;
+                row += Grid::PAGE_SIZE;
+            }
+        }
+    }
+
+    if (tileIndex != tileCount) {
+        spdlog::warn("Grid file page ({}, {}) is corrupt, decoded {} of {} tiles", pageX, pageY,
+                     tileIndex, tileCount);
+    }
+
+    return page;
+}
+
+GridTile GridFile::decodeTile(const EncodedRun& run) const {
+    return GridTile{
+        run.id, run.variant < variantRemap.size() ? variantRemap[run.variant] : TILE_VARIANT_NONE,
+        run.walkable == GridTile::WALKABLE ? GridTile::WALKABLE : GridTile::BLOCKED,
+        run.orientation};
+}
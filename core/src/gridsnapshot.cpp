@@ -0,0 +1,127 @@
+#include <gridsnapshot.h>
+
+#include <algorithm>
+
+namespace SpaceRogueLite {
+
+namespace {
+
+constexpr int CHUNKS_PER_PAGE = Grid::PAGE_SIZE / Grid::CHUNK_SIZE;
+static_assert(Grid::PAGE_SIZE % Grid::CHUNK_SIZE == 0);
+
+size_t pageTileIndex(int x, int y) {
+    return (y % Grid::PAGE_SIZE) * Grid::PAGE_SIZE + (x % Grid::PAGE_SIZE);
+}
+
+void forEachChangedPageChunk(const Grid::TilePage& page, const Grid::TilePage& previousPage,
+                             int pageX, int pageY, int chunkCountX, int chunkCountY,
+                             const std::function<void(int chunkX, int chunkY)>& callback) {
+    for (int localChunkY = 0; localChunkY < CHUNKS_PER_PAGE; ++localChunkY) {
+        for (int localChunkX = 0; localChunkX < CHUNKS_PER_PAGE; ++localChunkX) {
+            int chunkX = pageX * CHUNKS_PER_PAGE + localChunkX;
+            int chunkY = pageY * CHUNKS_PER_PAGE + localChunkY;
+
+            if (chunkX >= chunkCountX || chunkY >= chunkCountY) {
+                continue;
+            }
+
+            bool isChanged = false;
+
+            for (int row = 0; row < Grid::CHUNK_SIZE && !isChanged; ++row) {
+                size_t offset = (localChunkY * Grid::CHUNK_SIZE + row) * Grid::PAGE_SIZE +
+                                localChunkX * Grid::CHUNK_SIZE;
+
+                isChanged = !std::equal(page.tiles.begin() + offset,
+                                        page.tiles.begin() + offset + Grid::CHUNK_SIZE,
+                                        previousPage.tiles.begin() + offset);
+            }
+
+            if (isChanged) {
+                callback(chunkX, chunkY);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+GridSnapshot::GridSnapshot(uint64_t version, int width, int height,
+                           std::shared_ptr<const Grid::PageTable> pageTable)
+    : version(version), width(width), height(height), pageTable(std::move(pageTable)) {}
+
+uint64_t GridSnapshot::getVersion() const { return version; }
+
+int GridSnapshot::getWidth() const { return width; }
+
+int GridSnapshot::getHeight() const { return height; }
+
+GridRegion GridSnapshot::getBounds() const { return {0, 0, width, height}; }
+
+GridTile GridSnapshot::getTile(int x, int y) const {
+    if (!isValidPosition(x, y)) {
+        return TILE_DEFAULT;
+    }
+    return getPage(x, y).tiles[pageTileIndex(x, y)];
+}
+
+std::span<const GridTile> GridSnapshot::getRowSpan(int x, int y) const {
+    if (!isValidPosition(x, y)) {
+        return {};
+    }
+
+    int length = std::min(width, (x / Grid::PAGE_SIZE + 1) * Grid::PAGE_SIZE) - x;
+    return std::span<const GridTile>(&getPage(x, y).tiles[pageTileIndex(x, y)], length);
+}
+
+void GridSnapshot::forEachChangedChunk(
+    const GridSnapshot& previous, std::function<void(int chunkX, int chunkY)> callback) const {
+    const int chunkCountX = (width + Grid::CHUNK_SIZE - 1) / Grid::CHUNK_SIZE;
+    const int chunkCountY = (height + Grid::CHUNK_SIZE - 1) / Grid::CHUNK_SIZE;
+
+    if (previous.width != width || previous.height != height) {
+        for (int chunkY = 0; chunkY < chunkCountY; ++chunkY) {
+            for (int chunkX = 0; chunkX < chunkCountX; ++chunkX) {
+                callback(chunkX, chunkY);
+            }
+        }
+        return;
+    }
+
+    // The grid copies rows and pages before writing them, so anything still shared with the
+    // previous snapshot is unchanged. A replaced page may still have untouched chunks, compare
+    // those tile by tile
+    if (pageTable == previous.pageTable) {
+        return;
+    }
+
+    for (size_t pageY = 0; pageY < pageTable->size(); ++pageY) {
+        const auto& row = (*pageTable)[pageY];
+        const auto& previousRow = (*previous.pageTable)[pageY];
+
+        if (row == previousRow) {
+            continue;
+        }
+
+        for (size_t pageX = 0; pageX < row->size(); ++pageX) {
+            const auto& page = (*row)[pageX];
+            const auto& previousPage = (*previousRow)[pageX];
+
+            if (page == previousPage) {
+                continue;
+            }
+
+            forEachChangedPageChunk(*page, *previousPage, int(pageX), int(pageY), chunkCountX,
+                                    chunkCountY, callback);
+        }
+    }
+}
+
+bool GridSnapshot::isValidPosition(int x, int y) const {
+    return x >= 0 && x < width && y >= 0 && y < height;
+}
+
+const Grid::TilePage& GridSnapshot::getPage(int x, int y) const {
+    return *(*(*pageTable)[y / Grid::PAGE_SIZE])[x / Grid::PAGE_SIZE];
+}
+
+}  // namespace SpaceRogueLite
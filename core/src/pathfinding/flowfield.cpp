@@ -0,0 +1,466 @@
+#include "pathfinding/flowfield.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "utils/threadpool.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr float DIAGONAL_COST = 1.41421356f;
+
+float getStepCost(int8_t direction) { return direction >= 4 ? DIAGONAL_COST : 1.0f; }
+
+}  // namespace
+
+FlowFieldService::FlowFieldService(Grid& grid)
+    : grid(grid),
+      dirtyConsumer(grid.registerDirtyConsumer()),
+      walkability(grid.getWalkability()) {}
+
+FlowFieldService::~FlowFieldService() { grid.unregisterDirtyConsumer(dirtyConsumer); }
+
+void FlowFieldService::update(void) {
+    if (!grid.isDirty(dirtyConsumer)) {
+        return;
+    }
+
+    // Resizes and bulk tile changes dirty every chunk, cheaper to start over
+    size_t dirtyChunkCount = 0;
+    grid.forEachDirtyChunk(dirtyConsumer, [&](int, int) { dirtyChunkCount++; });
+
+    if (dirtyChunkCount == size_t(grid.getChunkCountX()) * grid.getChunkCountY()) {
+        grid.clearDirty(dirtyConsumer);
+
+        chunkCountX = grid.getChunkCountX();
+        chunkCountY = grid.getChunkCountY();
+        clearCache();
+        return;
+    }
+
+    std::vector<uint8_t> isDirtyChunk(size_t(chunkCountX) * chunkCountY, 0);
+
+    grid.consumeDirtyChunks(dirtyConsumer, [&](int chunkX, int chunkY) {
+        isDirtyChunk[chunkY * chunkCountX + chunkX] = 1;
+    });
+
+    invalidateChunks(isDirtyChunk);
+}
+
+std::shared_ptr<const FlowField> FlowFieldService::getFlowField(
+    const std::vector<glm::ivec2>& goals) {
+    update();
+
+    std::vector<int32_t> goalTiles;
+    for (const auto& goal : goals) {
+        if (walkability.isWalkable(goal.x, goal.y)) {
+            goalTiles.push_back(goal.y * walkability.getWidth() + goal.x);
+        }
+    }
+
+    std::sort(goalTiles.begin(), goalTiles.end());
+    goalTiles.erase(std::unique(goalTiles.begin(), goalTiles.end()), goalTiles.end());
+
+    // An exact match, otherwise the cached field needing the fewest goal changes to derive from
+    CacheEntry* closest = nullptr;
+    size_t closestChanges = MAX_INCREMENTAL_GOAL_CHANGES + 1;
+
+    for (auto& entry : cache) {
+        const auto& cachedGoals = entry.field->goals;
+
+        if (cachedGoals == goalTiles) {
+            entry.lastUsed = ++useCounter;
+            return entry.field;
+        }
+
+        std::vector<int32_t> sharedGoals;
+        std::set_intersection(cachedGoals.begin(), cachedGoals.end(), goalTiles.begin(),
+                              goalTiles.end(), std::back_inserter(sharedGoals));
+
+        // With nothing in common every tile gets reset, which is just a slower full build
+        size_t changes = cachedGoals.size() + goalTiles.size() - 2 * sharedGoals.size();
+        if (!sharedGoals.empty() && changes < closestChanges) {
+            closest = &entry;
+            closestChanges = changes;
+        }
+    }
+
+    auto field = closest != nullptr ? deriveFlowField(*closest->field, goalTiles)
+                                    : createFlowField(goalTiles);
+
+    if (cache.size() >= MAX_CACHED_FIELDS) {
+        auto leastRecent = std::min_element(
+            cache.begin(), cache.end(),
+            [](const CacheEntry& a, const CacheEntry& b) { return a.lastUsed < b.lastUsed; });
+        cache.erase(leastRecent);
+    }
+
+    cache.push_back({field, ++useCounter});
+    return field;
+}
+
+void FlowFieldService::clearCache(void) { cache.clear(); }
+
+size_t FlowFieldService::getCachedFieldCount(void) const { return cache.size(); }
+
+size_t FlowFieldService::getLastRelaxedChunkCount(void) const { return lastRelaxedChunkCount; }
+
+const WalkabilityBitmap& FlowFieldService::getWalkability(void) const { return walkability; }
+
+std::shared_ptr<FlowField> FlowFieldService::createFlowField(const std::vector<int32_t>& goals) {
+    auto field = std::make_shared<FlowField>();
+    const size_t tileCount = size_t(walkability.getWidth()) * walkability.getHeight();
+
+    field->width = walkability.getWidth();
+    field->height = walkability.getHeight();
+    field->goals = goals;
+    field->distances.assign(tileCount, FlowField::UNREACHABLE);
+    field->sources.assign(tileCount, -1);
+    field->directions.assign(tileCount, -1);
+    field->reachedChunks.assign(size_t(chunkCountX) * chunkCountY, 0);
+
+    std::vector<uint8_t> seededChunks(field->reachedChunks.size(), 0);
+
+    for (auto goal : goals) {
+        field->distances[goal] = 0.0f;
+        field->sources[goal] = goal;
+        seededChunks[getChunkIndex(goal)] = 1;
+    }
+
+    propagate(*field, seededChunks);
+    return field;
+}
+
+std::shared_ptr<FlowField> FlowFieldService::deriveFlowField(const FlowField& previous,
+                                                             const std::vector<int32_t>& goals) {
+    auto field = std::make_shared<FlowField>(previous);
+    field->goals = goals;
+
+    std::vector<int32_t> removedGoals;
+    std::set_difference(previous.goals.begin(), previous.goals.end(), goals.begin(), goals.end(),
+                        std::back_inserter(removedGoals));
+
+    std::vector<uint8_t> seededChunks(field->reachedChunks.size(), 0);
+
+    // Tiles leading to a removed goal have to be found again, everything else already holds its
+    // distance to a remaining goal and can only get closer to an added one
+    if (!removedGoals.empty()) {
+        for (size_t tile = 0; tile < field->sources.size(); tile++) {
+            int32_t source = field->sources[tile];
+
+            if (source != -1 &&
+                std::binary_search(removedGoals.begin(), removedGoals.end(), source)) {
+                field->distances[tile] = FlowField::UNREACHABLE;
+                field->sources[tile] = -1;
+                seededChunks[getChunkIndex(int32_t(tile))] = 1;
+            }
+        }
+    }
+
+    for (auto goal : goals) {
+        if (field->distances[goal] != 0.0f) {
+            field->distances[goal] = 0.0f;
+            field->sources[goal] = goal;
+            seededChunks[getChunkIndex(goal)] = 1;
+        }
+    }
+
+    propagate(*field, seededChunks);
+    return field;
+}
+
+void FlowFieldService::propagate(FlowField& field, const std::vector<uint8_t>& seededChunks) {
+    lastRelaxedChunkCount = 0;
+
+    // A 0x0 grid has no chunks to take a band from
+    if (seededChunks.empty()) {
+        return;
+    }
+
+    // Chunks only write their own tiles but read a one tile border around them, so chunks of the
+    // same 2x2 colour never touch each other's tiles and can be relaxed in parallel. Active chunks
+    // are taken in bands of increasing distance (delta stepping) so most are only settled once,
+    // rather than being relaxed again every time a shorter route arrives
+    std::vector<float> pendingDistances(seededChunks.size(), FlowField::UNREACHABLE);
+    std::vector<float> changedDistances(seededChunks.size(), FlowField::UNREACHABLE);
+    std::vector<uint8_t> isTouched = seededChunks;
+    std::vector<uint8_t> isSeeded = seededChunks;
+    std::vector<int32_t> batch;
+
+    for (size_t chunk = 0; chunk < seededChunks.size(); chunk++) {
+        if (seededChunks[chunk]) {
+            pendingDistances[chunk] = 0.0f;
+        }
+    }
+
+    float bandStart = *std::min_element(pendingDistances.begin(), pendingDistances.end());
+    while (bandStart != FlowField::UNREACHABLE) {
+        const float bandEnd = bandStart + DISTANCE_BAND;
+
+        for (int colour = 0; colour < 4; colour++) {
+            batch.clear();
+
+            for (int y = colour / 2; y < chunkCountY; y += 2) {
+                for (int x = colour % 2; x < chunkCountX; x += 2) {
+                    if (pendingDistances[y * chunkCountX + x] <= bandEnd) {
+                        pendingDistances[y * chunkCountX + x] = FlowField::UNREACHABLE;
+                        batch.push_back(y * chunkCountX + x);
+                    }
+                }
+            }
+
+            auto relaxRange = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    changedDistances[batch[i]] = relaxChunk(field, batch[i] % chunkCountX,
+                                                            batch[i] / chunkCountX,
+                                                            isSeeded[batch[i]]);
+                    isSeeded[batch[i]] = 0;
+                }
+            };
+
+            if (batch.size() >= PARALLEL_CHUNK_COUNT) {
+                Utils::getThreadPool().parallelFor(batch.size(), 1, relaxRange);
+            } else {
+                relaxRange(0, batch.size());
+            }
+
+            lastRelaxedChunkCount += batch.size();
+
+            // A chunk is settled against its neighbours once relaxed, so only the neighbours of
+            // chunks that changed need another pass
+            for (auto chunk : batch) {
+                float distance = changedDistances[chunk];
+
+                if (distance == FlowField::UNREACHABLE) {
+                    continue;
+                }
+
+                isTouched[chunk] = 1;
+                forEachNeighbourChunk(chunk, [&](int32_t neighbour) {
+                    pendingDistances[neighbour] = std::min(pendingDistances[neighbour], distance);
+                });
+            }
+        }
+
+        bandStart = *std::min_element(pendingDistances.begin(), pendingDistances.end());
+    }
+
+    // Directions read the distances of neighbouring tiles, so the chunks around a changed chunk
+    // need theirs redoing too
+    std::vector<uint8_t> needsDirections = isTouched;
+    for (size_t chunk = 0; chunk < isTouched.size(); chunk++) {
+        if (isTouched[chunk]) {
+            forEachNeighbourChunk(int32_t(chunk),
+                                  [&](int32_t neighbour) { needsDirections[neighbour] = 1; });
+        }
+    }
+
+    batch.clear();
+    for (size_t chunk = 0; chunk < needsDirections.size(); chunk++) {
+        if (needsDirections[chunk]) {
+            batch.push_back(int32_t(chunk));
+        }
+    }
+
+    auto directionRange = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            updateDirections(field, batch[i] % chunkCountX, batch[i] / chunkCountX);
+        }
+    };
+
+    if (batch.size() >= PARALLEL_CHUNK_COUNT) {
+        Utils::getThreadPool().parallelFor(batch.size(), PARALLEL_CHUNK_COUNT, directionRange);
+    } else {
+        directionRange(0, batch.size());
+    }
+}
+
+float FlowFieldService::relaxChunk(FlowField& field, int chunkX, int chunkY,
+                                   bool isSeeded) const {
+    thread_local std::vector<std::pair<float, int32_t>> heap;
+
+    const int width = field.width;
+    const int minX = chunkX * Grid::CHUNK_SIZE;
+    const int minY = chunkY * Grid::CHUNK_SIZE;
+    const int maxX = std::min(minX + Grid::CHUNK_SIZE, field.width) - 1;
+    const int maxY = std::min(minY + Grid::CHUNK_SIZE, field.height) - 1;
+
+    auto isInChunk = [&](int x, int y) { return x >= minX && x <= maxX && y >= minY && y <= maxY; };
+
+    float changedDistance = FlowField::UNREACHABLE;
+    heap.clear();
+
+    // Pull in anything cheaper from the tiles bordering the chunk, then run a Dijkstra inside it
+    // from the tiles that improved. The rest of the chunk is already settled from its last pass,
+    // unless goals or reset tiles were seeded into it
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            if (!walkability.isWalkable(x, y)) {
+                continue;
+            }
+
+            const int32_t tile = y * width + x;
+            bool isImproved = false;
+
+            if (x == minX || y == minY || x == maxX || y == maxY) {
+                for (int8_t direction = 0; direction < 8; direction++) {
+                    glm::ivec2 step = FlowField::getStep(direction);
+                    int nx = x + step.x;
+                    int ny = y + step.y;
+
+                    if (isInChunk(nx, ny) || !canMove(x, y, step.x, step.y)) {
+                        continue;
+                    }
+
+                    const int32_t neighbour = ny * width + nx;
+                    float distance = field.distances[neighbour] + getStepCost(direction);
+
+                    if (distance < field.distances[tile]) {
+                        field.distances[tile] = distance;
+                        field.sources[tile] = field.sources[neighbour];
+                        isImproved = true;
+                    }
+                }
+            }
+
+            // Seeded chunks may hold a new goal on their edge without improving any tiles, their
+            // neighbours still need to see it
+            if (isImproved || (isSeeded && field.distances[tile] != FlowField::UNREACHABLE)) {
+                heap.push_back({field.distances[tile], tile});
+                changedDistance = std::min(changedDistance, field.distances[tile]);
+            }
+        }
+    }
+
+    std::make_heap(heap.begin(), heap.end(), std::greater<>());
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        auto [distance, tile] = heap.back();
+        heap.pop_back();
+
+        if (distance > field.distances[tile]) {
+            continue;
+        }
+
+        const int x = tile % width;
+        const int y = tile / width;
+
+        for (int8_t direction = 0; direction < 8; direction++) {
+            glm::ivec2 step = FlowField::getStep(direction);
+
+            if (!isInChunk(x + step.x, y + step.y) || !canMove(x, y, step.x, step.y)) {
+                continue;
+            }
+
+            const int32_t neighbour = (y + step.y) * width + x + step.x;
+            const float neighbourDistance = distance + getStepCost(direction);
+
+            if (neighbourDistance < field.distances[neighbour]) {
+                field.distances[neighbour] = neighbourDistance;
+                field.sources[neighbour] = field.sources[tile];
+                heap.push_back({neighbourDistance, neighbour});
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+                changedDistance = std::min(changedDistance, neighbourDistance);
+            }
+        }
+    }
+
+    return changedDistance;
+}
+
+void FlowFieldService::updateDirections(FlowField& field, int chunkX, int chunkY) const {
+    const int width = field.width;
+    const int minX = chunkX * Grid::CHUNK_SIZE;
+    const int minY = chunkY * Grid::CHUNK_SIZE;
+    const int maxX = std::min(minX + Grid::CHUNK_SIZE, field.width) - 1;
+    const int maxY = std::min(minY + Grid::CHUNK_SIZE, field.height) - 1;
+
+    bool isReached = false;
+
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            const int32_t tile = y * width + x;
+            float best = field.distances[tile];
+            int8_t bestDirection = -1;
+
+            isReached |= best != FlowField::UNREACHABLE;
+
+            // Step along the edge the distance came from, the cheapest neighbour plus move cost
+            if (best != FlowField::UNREACHABLE && best != 0.0f) {
+                best = FlowField::UNREACHABLE;
+
+                for (int8_t direction = 0; direction < 8; direction++) {
+                    glm::ivec2 step = FlowField::getStep(direction);
+
+                    if (!canMove(x, y, step.x, step.y)) {
+                        continue;
+                    }
+
+                    float distance =
+                        field.distances[(y + step.y) * width + x + step.x] + getStepCost(direction);
+                    if (distance < best) {
+                        best = distance;
+                        bestDirection = direction;
+                    }
+                }
+            }
+
+            field.directions[tile] = bestDirection;
+        }
+    }
+
+    field.reachedChunks[chunkY * chunkCountX + chunkX] = isReached;
+}
+
+void FlowFieldService::invalidateChunks(const std::vector<uint8_t>& isDirtyChunk) {
+    // A change next to a reached chunk can open up a new route into it, so borders count too
+    auto isAffected = [&](const FlowField& field) {
+        bool isReached = false;
+
+        for (size_t chunk = 0; chunk < isDirtyChunk.size() && !isReached; chunk++) {
+            if (isDirtyChunk[chunk]) {
+                isReached = field.reachedChunks[chunk];
+                forEachNeighbourChunk(int32_t(chunk), [&](int32_t neighbour) {
+                    isReached |= field.reachedChunks[neighbour] != 0;
+                });
+            }
+        }
+
+        return isReached;
+    };
+
+    cache.erase(std::remove_if(cache.begin(), cache.end(),
+                               [&](const CacheEntry& entry) { return isAffected(*entry.field); }),
+                cache.end());
+}
+
+void FlowFieldService::forEachNeighbourChunk(int32_t chunk,
+                                             const std::function<void(int32_t)>& callback) const {
+    const int chunkX = chunk % chunkCountX;
+    const int chunkY = chunk / chunkCountX;
+
+    for (int y = std::max(0, chunkY - 1); y <= std::min(chunkCountY - 1, chunkY + 1); y++) {
+        for (int x = std::max(0, chunkX - 1); x <= std::min(chunkCountX - 1, chunkX + 1); x++) {
+            if (x != chunkX || y != chunkY) {
+                callback(y * chunkCountX + x);
+            }
+        }
+    }
+}
+
+int FlowFieldService::getChunkIndex(int32_t tile) const {
+    const int width = walkability.getWidth();
+    return (tile / width / Grid::CHUNK_SIZE) * chunkCountX + (tile % width) / Grid::CHUNK_SIZE;
+}
+
+bool FlowFieldService::canMove(int x, int y, int dx, int dy) const {
+    if (!walkability.isWalkable(x + dx, y + dy)) {
+        return false;
+    }
+
+    return dx == 0 || dy == 0 ||
+           (walkability.isWalkable(x + dx, y) && walkability.isWalkable(x, y + dy));
+}
@@ -0,0 +1,451 @@
+#include "pathfinding/hierarchicalpathfinder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr float UNREACHABLE = std::numeric_limits<float>::infinity();
+constexpr float DIAGONAL_COST = 1.41421356f;
+
+constexpr int DIRECTIONS[8][2] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                                  {1, 1},  {1, -1}, {-1, 1}, {-1, -1}};
+
+float octileDistance(const glm::ivec2& from, const glm::ivec2& to) {
+    int dx = std::abs(to.x - from.x);
+    int dy = std::abs(to.y - from.y);
+    return float(std::max(dx, dy) - std::min(dx, dy)) + DIAGONAL_COST * float(std::min(dx, dy));
+}
+
+}  // namespace
+
+HierarchicalPathfinder::HierarchicalPathfinder(Grid& grid)
+    : grid(grid),
+      dirtyConsumer(grid.registerDirtyConsumer()),
+      walkability(grid.getWalkability()) {}
+
+HierarchicalPathfinder::~HierarchicalPathfinder() { grid.unregisterDirtyConsumer(dirtyConsumer); }
+
+void HierarchicalPathfinder::update(void) {
+    if (!grid.isDirty(dirtyConsumer)) {
+        return;
+    }
+
+    std::vector<glm::ivec2> dirtyChunks;
+    grid.consumeDirtyChunks(dirtyConsumer, [&](int chunkX, int chunkY) {
+        dirtyChunks.push_back(glm::ivec2(chunkX, chunkY));
+    });
+
+    // Resizes and bulk tile changes dirty every chunk
+    if (dirtyChunks.size() == size_t(grid.getChunkCountX()) * grid.getChunkCountY()) {
+        rebuildAllClusters();
+        return;
+    }
+
+    // Entrances are derived from the tiles either side of a border, so the neighbours of a dirty
+    // cluster have to be rebuilt along with it
+    std::vector<uint8_t> isRebuildNeeded(clusters.size(), 0);
+
+    for (const auto& chunk : dirtyChunks) {
+        const int chunkX = chunk.x;
+        const int chunkY = chunk.y;
+
+        for (int y = std::max(0, chunkY - 1); y <= std::min(clusterCountY - 1, chunkY + 1); y++) {
+            for (int x = std::max(0, chunkX - 1); x <= std::min(clusterCountX - 1, chunkX + 1);
+                 x++) {
+                if (std::abs(x - chunkX) + std::abs(y - chunkY) <= 1) {
+                    isRebuildNeeded[y * clusterCountX + x] = 1;
+                }
+            }
+        }
+    }
+
+    lastRebuiltClusterCount = 0;
+    for (int y = 0; y < clusterCountY; y++) {
+        for (int x = 0; x < clusterCountX; x++) {
+            if (isRebuildNeeded[y * clusterCountX + x]) {
+                rebuildCluster(x, y);
+                lastRebuiltClusterCount++;
+            }
+        }
+    }
+}
+
+bool HierarchicalPathfinder::findPath(const glm::ivec2& start, const glm::ivec2& goal,
+                                      PathResult& result) {
+    update();
+
+    result.found = false;
+    result.cost = 0.0f;
+    result.expandedNodes = 0;
+    result.path.clear();
+
+    // Also rejects blocked end points, which have no region
+    if (!grid.isReachable(start, goal)) {
+        return false;
+    }
+
+    const int32_t startClusterIndex = getClusterIndex(start);
+    const int32_t goalClusterIndex = getClusterIndex(goal);
+    const auto& startCluster = clusters[startClusterIndex];
+    const auto& goalCluster = clusters[goalClusterIndex];
+
+    ClusterSearch startSearch;
+    searchCluster(startCluster, start, startSearch);
+
+    // Short hops are resolved inside the cluster without touching the abstract graph
+    if (startClusterIndex == goalClusterIndex) {
+        float cost = startSearch.distances[getLocalIndex(startCluster, goal)];
+
+        if (cost != UNREACHABLE) {
+            result.found = true;
+            result.cost = cost;
+            result.path.push_back(start);
+            appendClusterPath(startCluster, startSearch, goal, result.path);
+            return true;
+        }
+    }
+
+    ClusterSearch goalSearch;
+    searchCluster(goalCluster, goal, goalSearch);
+
+    if (++generation == 0) {
+        for (auto& node : abstractNodes) {
+            node.generation = 0;
+        }
+        generation = 1;
+    }
+
+    const int32_t goalNode = int32_t(clusters.size()) * MAX_ENTRANCES;
+    openSet.clear();
+
+    auto getPosition = [&](int32_t node) {
+        return clusters[node / MAX_ENTRANCES].entrances[node % MAX_ENTRANCES];
+    };
+
+    auto relax = [&](int32_t node, int32_t parent, float g) {
+        auto& abstractNode = abstractNodes[node];
+
+        bool isVisited = abstractNode.generation == generation;
+        if (isVisited && (abstractNode.closed || abstractNode.g <= g)) {
+            return;
+        }
+
+        abstractNode = {g, parent, generation, false};
+
+        float h = node == goalNode ? 0.0f : octileDistance(getPosition(node), goal);
+        openSet.push_back({g + h, node});
+        std::push_heap(openSet.begin(), openSet.end(), std::greater<>());
+    };
+
+    for (size_t i = 0; i < startCluster.entrances.size(); i++) {
+        float cost = startSearch.distances[getLocalIndex(startCluster, startCluster.entrances[i])];
+
+        if (cost != UNREACHABLE) {
+            relax(startClusterIndex * MAX_ENTRANCES + int32_t(i), -1, cost);
+        }
+    }
+
+    while (!openSet.empty()) {
+        std::pop_heap(openSet.begin(), openSet.end(), std::greater<>());
+        int32_t node = openSet.back().second;
+        openSet.pop_back();
+
+        // Stale entries are left in the heap when a node is reached more cheaply
+        if (abstractNodes[node].closed) {
+            continue;
+        }
+
+        if (node == goalNode) {
+            break;
+        }
+
+        abstractNodes[node].closed = true;
+        result.expandedNodes++;
+
+        const float g = abstractNodes[node].g;
+
+        const int32_t clusterIndex = node / MAX_ENTRANCES;
+        const int32_t entrance = node % MAX_ENTRANCES;
+        const auto& cluster = clusters[clusterIndex];
+        const auto& position = cluster.entrances[entrance];
+        const size_t entranceCount = cluster.entrances.size();
+
+        for (size_t i = 0; i < entranceCount; i++) {
+            float cost = cluster.distances[entrance * entranceCount + i];
+
+            if (int32_t(i) != entrance && cost != UNREACHABLE) {
+                relax(clusterIndex * MAX_ENTRANCES + int32_t(i), node, g + cost);
+            }
+        }
+
+        for (int i = 0; i < 4; i++) {
+            glm::ivec2 neighbour(position.x + DIRECTIONS[i][0], position.y + DIRECTIONS[i][1]);
+
+            if (!walkability.isWalkable(neighbour.x, neighbour.y)) {
+                continue;
+            }
+
+            int32_t neighbourClusterIndex = getClusterIndex(neighbour);
+            if (neighbourClusterIndex == clusterIndex) {
+                continue;
+            }
+
+            const auto& neighbourCluster = clusters[neighbourClusterIndex];
+            int8_t neighbourEntrance =
+                neighbourCluster.entranceIndex[getLocalIndex(neighbourCluster, neighbour)];
+
+            if (neighbourEntrance != -1) {
+                relax(neighbourClusterIndex * MAX_ENTRANCES + neighbourEntrance, node, g + 1.0f);
+            }
+        }
+
+        if (clusterIndex == goalClusterIndex) {
+            float cost = goalSearch.distances[getLocalIndex(cluster, position)];
+
+            if (cost != UNREACHABLE) {
+                relax(goalNode, node, g + cost);
+            }
+        }
+    }
+
+    if (abstractNodes[goalNode].generation != generation) {
+        return false;
+    }
+
+    std::vector<glm::ivec2> waypoints = {goal};
+    for (int32_t node = abstractNodes[goalNode].parent; node != -1;
+         node = abstractNodes[node].parent) {
+        waypoints.push_back(getPosition(node));
+    }
+    waypoints.push_back(start);
+    std::reverse(waypoints.begin(), waypoints.end());
+
+    result.found = true;
+    result.cost = abstractNodes[goalNode].g;
+    refinePath(waypoints, startSearch, goalSearch, result);
+
+    return true;
+}
+
+size_t HierarchicalPathfinder::getEntranceCount(void) const {
+    size_t count = 0;
+
+    for (const auto& cluster : clusters) {
+        count += cluster.entrances.size();
+    }
+
+    return count;
+}
+
+size_t HierarchicalPathfinder::getLastRebuiltClusterCount(void) const {
+    return lastRebuiltClusterCount;
+}
+
+const WalkabilityBitmap& HierarchicalPathfinder::getWalkability(void) const { return walkability; }
+
+void HierarchicalPathfinder::rebuildAllClusters(void) {
+    clusterCountX = (walkability.getWidth() + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    clusterCountY = (walkability.getHeight() + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+    clusters.assign(size_t(clusterCountX) * clusterCountY, Cluster{});
+    abstractNodes.assign(clusters.size() * MAX_ENTRANCES + 1, AbstractNode{0.0f, -1, 0, false});
+    generation = 0;
+
+    for (int y = 0; y < clusterCountY; y++) {
+        for (int x = 0; x < clusterCountX; x++) {
+            rebuildCluster(x, y);
+        }
+    }
+
+    lastRebuiltClusterCount = clusters.size();
+}
+
+void HierarchicalPathfinder::rebuildCluster(int clusterX, int clusterY) {
+    auto& cluster = clusters[clusterY * clusterCountX + clusterX];
+
+    cluster.min = glm::ivec2(clusterX * CLUSTER_SIZE, clusterY * CLUSTER_SIZE);
+    cluster.max = glm::min(cluster.min + (CLUSTER_SIZE - 1),
+                           glm::ivec2(walkability.getWidth() - 1, walkability.getHeight() - 1));
+    cluster.entrances.clear();
+    cluster.entranceIndex.fill(-1);
+
+    const int clusterWidth = cluster.max.x - cluster.min.x + 1;
+    const int clusterHeight = cluster.max.y - cluster.min.y + 1;
+
+    // Neighbouring clusters scan the same tile pairs, so entrances always come in matching pairs
+    addBorderEntrances(cluster, cluster.min, {1, 0}, {0, -1}, clusterWidth);
+    addBorderEntrances(cluster, {cluster.min.x, cluster.max.y}, {1, 0}, {0, 1}, clusterWidth);
+    addBorderEntrances(cluster, cluster.min, {0, 1}, {-1, 0}, clusterHeight);
+    addBorderEntrances(cluster, {cluster.max.x, cluster.min.y}, {0, 1}, {1, 0}, clusterHeight);
+
+    const size_t entranceCount = cluster.entrances.size();
+    cluster.distances.assign(entranceCount * entranceCount, UNREACHABLE);
+
+    ClusterSearch search;
+    for (size_t i = 0; i < entranceCount; i++) {
+        searchCluster(cluster, cluster.entrances[i], search);
+
+        for (size_t j = 0; j < entranceCount; j++) {
+            cluster.distances[i * entranceCount + j] =
+                search.distances[getLocalIndex(cluster, cluster.entrances[j])];
+        }
+    }
+}
+
+void HierarchicalPathfinder::addBorderEntrances(Cluster& cluster, const glm::ivec2& from,
+                                                const glm::ivec2& along,
+                                                const glm::ivec2& outward, int length) {
+    auto addEntrance = [&](int offset) {
+        glm::ivec2 position = from + along * offset;
+        auto& index = cluster.entranceIndex[getLocalIndex(cluster, position)];
+
+        if (index == -1) {
+            index = int8_t(cluster.entrances.size());
+            cluster.entrances.push_back(position);
+        }
+    };
+
+    int runStart = -1;
+
+    for (int i = 0; i <= length; i++) {
+        glm::ivec2 inside = from + along * i;
+        glm::ivec2 outside = inside + outward;
+
+        bool isOpen = i < length && walkability.isWalkable(inside.x, inside.y) &&
+                      walkability.isWalkable(outside.x, outside.y);
+
+        if (isOpen && runStart == -1) {
+            runStart = i;
+        } else if (!isOpen && runStart != -1) {
+            int runLength = i - runStart;
+
+            if (runLength < ENTRANCE_SPLIT_LENGTH) {
+                addEntrance(runStart + runLength / 2);
+            } else {
+                addEntrance(runStart);
+                addEntrance(i - 1);
+            }
+
+            runStart = -1;
+        }
+    }
+}
+
+void HierarchicalPathfinder::searchCluster(const Cluster& cluster, const glm::ivec2& source,
+                                           ClusterSearch& search) const {
+    thread_local std::vector<std::pair<float, int16_t>> heap;
+
+    search.distances.fill(UNREACHABLE);
+    search.parents.fill(-1);
+
+    const int16_t sourceIndex = int16_t(getLocalIndex(cluster, source));
+    search.distances[sourceIndex] = 0.0f;
+
+    heap.clear();
+    heap.push_back({0.0f, sourceIndex});
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        auto [distance, current] = heap.back();
+        heap.pop_back();
+
+        if (distance > search.distances[current]) {
+            continue;
+        }
+
+        const int x = cluster.min.x + current % CLUSTER_SIZE;
+        const int y = cluster.min.y + current / CLUSTER_SIZE;
+
+        for (const auto& direction : DIRECTIONS) {
+            const int nx = x + direction[0];
+            const int ny = y + direction[1];
+
+            if (nx < cluster.min.x || ny < cluster.min.y || nx > cluster.max.x ||
+                ny > cluster.max.y || !canMove(x, y, direction[0], direction[1])) {
+                continue;
+            }
+
+            const int16_t neighbour = int16_t(getLocalIndex(cluster, {nx, ny}));
+            const float cost =
+                distance + (direction[0] != 0 && direction[1] != 0 ? DIAGONAL_COST : 1.0f);
+
+            if (cost < search.distances[neighbour]) {
+                search.distances[neighbour] = cost;
+                search.parents[neighbour] = current;
+                heap.push_back({cost, neighbour});
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+            }
+        }
+    }
+}
+
+void HierarchicalPathfinder::appendClusterPath(const Cluster& cluster, const ClusterSearch& search,
+                                               const glm::ivec2& to,
+                                               std::vector<glm::ivec2>& path) const {
+    // Parents lead back to the search source, which is already on the path
+    size_t segmentStart = path.size();
+
+    for (int16_t current = int16_t(getLocalIndex(cluster, to)); search.parents[current] != -1;
+         current = search.parents[current]) {
+        path.push_back(cluster.min + glm::ivec2(current % CLUSTER_SIZE, current / CLUSTER_SIZE));
+    }
+
+    std::reverse(path.begin() + segmentStart, path.end());
+}
+
+void HierarchicalPathfinder::refinePath(const std::vector<glm::ivec2>& waypoints,
+                                        const ClusterSearch& startSearch,
+                                        const ClusterSearch& goalSearch,
+                                        PathResult& result) const {
+    auto& path = result.path;
+    path.push_back(waypoints.front());
+
+    ClusterSearch search;
+    const size_t lastSegment = waypoints.size() - 2;
+
+    for (size_t i = 0; i <= lastSegment; i++) {
+        const auto& from = waypoints[i];
+        const auto& to = waypoints[i + 1];
+        const auto& cluster = clusters[getClusterIndex(from)];
+
+        if (getClusterIndex(to) != getClusterIndex(from)) {
+            // Step across a border between paired entrances
+            path.push_back(to);
+        } else if (i == 0) {
+            appendClusterPath(cluster, startSearch, to, path);
+        } else if (i == lastSegment) {
+            // The goal search runs from the goal, so its parents already point the right way
+            for (int16_t current = goalSearch.parents[getLocalIndex(cluster, from)]; current != -1;
+                 current = goalSearch.parents[current]) {
+                path.push_back(cluster.min +
+                               glm::ivec2(current % CLUSTER_SIZE, current / CLUSTER_SIZE));
+            }
+        } else {
+            searchCluster(cluster, from, search);
+            appendClusterPath(cluster, search, to, path);
+        }
+    }
+}
+
+int32_t HierarchicalPathfinder::getClusterIndex(const glm::ivec2& position) const {
+    return (position.y / CLUSTER_SIZE) * clusterCountX + position.x / CLUSTER_SIZE;
+}
+
+int HierarchicalPathfinder::getLocalIndex(const Cluster& cluster,
+                                          const glm::ivec2& position) const {
+    return (position.y - cluster.min.y) * CLUSTER_SIZE + (position.x - cluster.min.x);
+}
+
+bool HierarchicalPathfinder::canMove(int x, int y, int dx, int dy) const {
+    if (!walkability.isWalkable(x + dx, y + dy)) {
+        return false;
+    }
+
+    return dx == 0 || dy == 0 ||
+           (walkability.isWalkable(x + dx, y) && walkability.isWalkable(x, y + dy));
+}
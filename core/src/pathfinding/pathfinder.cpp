@@ -0,0 +1,388 @@
+#include "pathfinding/pathfinder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "utils/threadpool.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+constexpr float DIAGONAL_COST = 1.41421356f;
+
+constexpr int DIRECTIONS[8][2] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                                  {1, 1},  {1, -1}, {-1, 1}, {-1, -1}};
+
+int sign(int value) { return (value > 0) - (value < 0); }
+
+float octileDistance(int dx, int dy) {
+    dx = std::abs(dx);
+    dy = std::abs(dy);
+    return float(std::max(dx, dy) - std::min(dx, dy)) + DIAGONAL_COST * float(std::min(dx, dy));
+}
+
+}  // namespace
+
+Pathfinder::Pathfinder(Grid& grid) : grid(grid), walkability(grid.getWalkability()) {}
+
+void Pathfinder::update(void) {
+    // Searches only read the labels, so they're safe to run in parallel once these are refreshed
+    grid.updateRegions();
+}
+
+bool Pathfinder::findPath(const glm::ivec2& start, const glm::ivec2& goal, Mode mode,
+                          PathResult& result) {
+    update();
+
+    auto workspace = acquireWorkspace();
+    search(*workspace, start, goal, mode, result);
+    releaseWorkspace(std::move(workspace));
+
+    return result.found;
+}
+
+void Pathfinder::findPaths(const std::vector<PathQuery>& queries, Mode mode,
+                           std::vector<PathResult>& results) {
+    update();
+
+    results.resize(queries.size());
+
+    auto searchRange = [&](size_t begin, size_t end) {
+        auto workspace = acquireWorkspace();
+
+        for (size_t i = begin; i < end; i++) {
+            search(*workspace, queries[i].start, queries[i].goal, mode, results[i]);
+        }
+
+        releaseWorkspace(std::move(workspace));
+    };
+
+    if (queries.size() >= PARALLEL_QUERY_COUNT) {
+        Utils::getThreadPool().parallelFor(queries.size(), PARALLEL_QUERY_COUNT / 2, searchRange);
+    } else {
+        searchRange(0, queries.size());
+    }
+}
+
+const WalkabilityBitmap& Pathfinder::getWalkability(void) const { return walkability; }
+
+std::unique_ptr<Pathfinder::Workspace> Pathfinder::acquireWorkspace(void) {
+    std::unique_ptr<Workspace> workspace;
+
+    {
+        std::lock_guard<std::mutex> lock(workspaceMutex);
+
+        if (!freeWorkspaces.empty()) {
+            workspace = std::move(freeWorkspaces.back());
+            freeWorkspaces.pop_back();
+        }
+    }
+
+    if (!workspace) {
+        workspace = std::make_unique<Workspace>();
+    }
+
+    size_t nodeCount = size_t(walkability.getWidth()) * walkability.getHeight();
+    if (workspace->nodes.size() != nodeCount) {
+        workspace->nodes.assign(nodeCount, Node{0.0f, 0.0f, -1, -1, 0, false});
+        workspace->generation = 0;
+    }
+
+    return workspace;
+}
+
+void Pathfinder::releaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(workspaceMutex);
+    freeWorkspaces.push_back(std::move(workspace));
+}
+
+void Pathfinder::search(Workspace& workspace, const glm::ivec2& start, const glm::ivec2& goal,
+                        Mode mode, PathResult& result) const {
+    result.found = false;
+    result.cost = 0.0f;
+    result.expandedNodes = 0;
+    result.path.clear();
+
+    // Also rejects blocked end points, which have no region
+    if (!grid.isReachable(start, goal)) {
+        return;
+    }
+
+    // Bumping the generation invalidates every node from the previous search without touching
+    // them. On wrap around the stamps have to be cleared for real
+    if (++workspace.generation == 0) {
+        for (auto& node : workspace.nodes) {
+            node.generation = 0;
+        }
+        workspace.generation = 1;
+    }
+    workspace.heap.clear();
+
+    const int width = walkability.getWidth();
+    const int32_t startIndex = start.y * width + start.x;
+    const int32_t goalIndex = goal.y * width + goal.x;
+
+    auto& startNode = workspace.nodes[startIndex];
+    startNode = {0.0f, heuristic(startIndex, goalIndex), -1, -1, workspace.generation, false};
+    heapPush(workspace, startIndex);
+
+    while (!workspace.heap.empty()) {
+        int32_t current = heapPop(workspace);
+
+        if (current == goalIndex) {
+            buildPath(workspace, goalIndex, result);
+            return;
+        }
+
+        workspace.nodes[current].closed = true;
+        result.expandedNodes++;
+
+        if (mode == JUMP_POINT) {
+            expandJumpPoints(workspace, current, goalIndex);
+        } else {
+            expandNeighbours(workspace, current, goalIndex);
+        }
+    }
+}
+
+void Pathfinder::expandNeighbours(Workspace& workspace, int32_t current, int32_t goal) const {
+    const int width = walkability.getWidth();
+    const int x = current % width;
+    const int y = current / width;
+
+    for (const auto& direction : DIRECTIONS) {
+        if (canMove(x, y, direction[0], direction[1])) {
+            relax(workspace, current, (y + direction[1]) * width + x + direction[0], goal);
+        }
+    }
+}
+
+void Pathfinder::expandJumpPoints(Workspace& workspace, int32_t current, int32_t goal) const {
+    const int width = walkability.getWidth();
+    const int x = current % width;
+    const int y = current / width;
+    const int32_t parent = workspace.nodes[current].parent;
+
+    auto tryJump = [&](int dx, int dy) {
+        if (!canMove(x, y, dx, dy)) {
+            return;
+        }
+
+        int32_t jumpPoint = jump(x + dx, y + dy, dx, dy, goal);
+        if (jumpPoint != -1) {
+            relax(workspace, current, jumpPoint, goal);
+        }
+    };
+
+    if (parent == -1) {
+        for (const auto& direction : DIRECTIONS) {
+            tryJump(direction[0], direction[1]);
+        }
+        return;
+    }
+
+    // Pruned neighbours for diagonal moves that never cut corners. Straight moves also have to
+    // look sideways, since a diagonal step can only be taken once both orthogonals are open
+    const int dx = sign(x - parent % width);
+    const int dy = sign(y - parent / width);
+
+    if (dx != 0 && dy != 0) {
+        tryJump(dx, 0);
+        tryJump(0, dy);
+        tryJump(dx, dy);
+    } else if (dx != 0) {
+        tryJump(dx, 0);
+        tryJump(dx, 1);
+        tryJump(dx, -1);
+        tryJump(0, 1);
+        tryJump(0, -1);
+    } else {
+        tryJump(0, dy);
+        tryJump(1, dy);
+        tryJump(-1, dy);
+        tryJump(1, 0);
+        tryJump(-1, 0);
+    }
+}
+
+int32_t Pathfinder::jump(int x, int y, int dx, int dy, int32_t goal) const {
+    const int width = walkability.getWidth();
+
+    while (true) {
+        if (!isWalkable(x, y)) {
+            return -1;
+        }
+
+        const int32_t index = y * width + x;
+        if (index == goal) {
+            return index;
+        }
+
+        if (dx != 0 && dy != 0) {
+            if (jump(x + dx, y, dx, 0, goal) != -1 || jump(x, y + dy, 0, dy, goal) != -1) {
+                return index;
+            }
+
+            if (!isWalkable(x + dx, y) || !isWalkable(x, y + dy)) {
+                return -1;
+            }
+        } else if (dx != 0) {
+            if ((isWalkable(x, y - 1) && !isWalkable(x - dx, y - 1)) ||
+                (isWalkable(x, y + 1) && !isWalkable(x - dx, y + 1))) {
+                return index;
+            }
+        } else {
+            if ((isWalkable(x - 1, y) && !isWalkable(x - 1, y - dy)) ||
+                (isWalkable(x + 1, y) && !isWalkable(x + 1, y - dy))) {
+                return index;
+            }
+        }
+
+        x += dx;
+        y += dy;
+    }
+}
+
+void Pathfinder::relax(Workspace& workspace, int32_t from, int32_t to, int32_t goal) const {
+    const int width = walkability.getWidth();
+    auto& node = workspace.nodes[to];
+
+    bool isVisited = node.generation == workspace.generation;
+    if (isVisited && node.closed) {
+        return;
+    }
+
+    float g = workspace.nodes[from].g +
+              octileDistance(to % width - from % width, to / width - from / width);
+
+    if (!isVisited) {
+        node = {g, g + heuristic(to, goal), from, -1, workspace.generation, false};
+        heapPush(workspace, to);
+    } else if (g < node.g) {
+        node.f -= node.g - g;
+        node.g = g;
+        node.parent = from;
+        heapSiftUp(workspace, node.heapIndex);
+    }
+}
+
+void Pathfinder::buildPath(const Workspace& workspace, int32_t goal, PathResult& result) const {
+    const int width = walkability.getWidth();
+
+    result.found = true;
+    result.cost = workspace.nodes[goal].g;
+
+    // Walk back through the parents, filling in the straight or diagonal runs between jump points
+    for (int32_t current = goal; current != -1; current = workspace.nodes[current].parent) {
+        glm::ivec2 position(current % width, current / width);
+        int32_t parent = workspace.nodes[current].parent;
+
+        if (parent == -1) {
+            result.path.push_back(position);
+            break;
+        }
+
+        glm::ivec2 parentPosition(parent % width, parent / width);
+        glm::ivec2 step(sign(parentPosition.x - position.x), sign(parentPosition.y - position.y));
+
+        for (; position != parentPosition; position += step) {
+            result.path.push_back(position);
+        }
+    }
+
+    std::reverse(result.path.begin(), result.path.end());
+}
+
+bool Pathfinder::canMove(int x, int y, int dx, int dy) const {
+    if (!isWalkable(x + dx, y + dy)) {
+        return false;
+    }
+
+    return dx == 0 || dy == 0 || (isWalkable(x + dx, y) && isWalkable(x, y + dy));
+}
+
+float Pathfinder::heuristic(int32_t from, int32_t to) const {
+    const int width = walkability.getWidth();
+    return octileDistance(to % width - from % width, to / width - from / width);
+}
+
+void Pathfinder::heapPush(Workspace& workspace, int32_t node) const {
+    workspace.heap.push_back(node);
+    workspace.nodes[node].heapIndex = int32_t(workspace.heap.size()) - 1;
+    heapSiftUp(workspace, workspace.nodes[node].heapIndex);
+}
+
+int32_t Pathfinder::heapPop(Workspace& workspace) const {
+    auto& heap = workspace.heap;
+    int32_t top = heap.front();
+
+    heap.front() = heap.back();
+    workspace.nodes[heap.front()].heapIndex = 0;
+    heap.pop_back();
+    workspace.nodes[top].heapIndex = -1;
+
+    if (!heap.empty()) {
+        heapSiftDown(workspace, 0);
+    }
+
+    return top;
+}
+
+void Pathfinder::heapSiftUp(Workspace& workspace, int32_t position) const {
+    auto& heap = workspace.heap;
+    int32_t node = heap[position];
+
+    while (position > 0) {
+        int32_t parent = (position - 1) / 2;
+
+        if (!heapLess(workspace, node, heap[parent])) {
+            break;
+        }
+
+        heap[position] = heap[parent];
+        workspace.nodes[heap[position]].heapIndex = position;
+        position = parent;
+    }
+
+    heap[position] = node;
+    workspace.nodes[node].heapIndex = position;
+}
+
+void Pathfinder::heapSiftDown(Workspace& workspace, int32_t position) const {
+    auto& heap = workspace.heap;
+    const int32_t size = int32_t(heap.size());
+    int32_t node = heap[position];
+
+    while (true) {
+        int32_t child = 2 * position + 1;
+
+        if (child >= size) {
+            break;
+        }
+
+        if (child + 1 < size && heapLess(workspace, heap[child + 1], heap[child])) {
+            child++;
+        }
+
+        if (!heapLess(workspace, heap[child], node)) {
+            break;
+        }
+
+        heap[position] = heap[child];
+        workspace.nodes[heap[position]].heapIndex = position;
+        position = child;
+    }
+
+    heap[position] = node;
+    workspace.nodes[node].heapIndex = position;
+}
+
+bool Pathfinder::heapLess(const Workspace& workspace, int32_t a, int32_t b) const {
+    const auto& nodeA = workspace.nodes[a];
+    const auto& nodeB = workspace.nodes[b];
+
+    // Prefer deeper nodes on ties, they're closer to the goal
+    return nodeA.f < nodeB.f || (nodeA.f == nodeB.f && nodeA.g > nodeB.g);
+}
@@ -0,0 +1,242 @@
+#include "spatialindex.h"
+
+#include <algorithm>
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+int64_t getDistanceSquared(const Position& a, const Position& b) {
+    int64_t dx = a.x - b.x;
+    int64_t dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+}  // namespace
+
+SpatialIndex::SpatialIndex(entt::registry& registry, int cellSize)
+    : registry(registry), cellSize(std::max(1, cellSize)) {
+    registry.on_construct<Position>().connect<&SpatialIndex::onConstruct>(*this);
+    registry.on_update<Position>().connect<&SpatialIndex::onUpdate>(*this);
+    registry.on_destroy<Position>().connect<&SpatialIndex::onDestroy>(*this);
+
+    rebuild();
+}
+
+SpatialIndex::~SpatialIndex() {
+    registry.on_construct<Position>().disconnect<&SpatialIndex::onConstruct>(*this);
+    registry.on_update<Position>().disconnect<&SpatialIndex::onUpdate>(*this);
+    registry.on_destroy<Position>().disconnect<&SpatialIndex::onDestroy>(*this);
+}
+
+void SpatialIndex::rebuild(void) {
+    cells.clear();
+    entries.clear();
+    minCell = glm::ivec2(0, 0);
+    maxCell = glm::ivec2(-1, -1);
+
+    registry.view<Position>().each(
+        [this](entt::entity entity, const Position& position) { insert(entity, position); });
+}
+
+void SpatialIndex::queryRadius(const Position& centre, int radius,
+                               std::vector<entt::entity>& results) const {
+    results.clear();
+
+    if (radius < 0) {
+        return;
+    }
+
+    const int64_t radiusSquared = int64_t(radius) * radius;
+
+    forEachInCells(getCell(centre - radius), getCell(centre + radius),
+                   [&](entt::entity entity, const Position& position) {
+                       if (getDistanceSquared(position, centre) <= radiusSquared) {
+                           results.push_back(entity);
+                       }
+                   });
+}
+
+void SpatialIndex::queryRect(const glm::ivec2& min, const glm::ivec2& max,
+                             std::vector<entt::entity>& results) const {
+    results.clear();
+
+    if (min.x > max.x || min.y > max.y) {
+        return;
+    }
+
+    forEachInCells(getCell(min), getCell(max), [&](entt::entity entity, const Position& position) {
+        if (position.x >= min.x && position.y >= min.y && position.x <= max.x &&
+            position.y <= max.y) {
+            results.push_back(entity);
+        }
+    });
+}
+
+void SpatialIndex::queryNearest(const Position& centre, size_t count,
+                                std::vector<entt::entity>& results) const {
+    results.clear();
+
+    if (count == 0 || entries.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<int64_t, entt::entity>> candidates;
+    auto collect = [&](entt::entity entity, const Position& position) {
+        candidates.push_back({getDistanceSquared(position, centre), entity});
+    };
+
+    // Search outwards a ring of cells at a time. Anything not yet visited is at least as far away
+    // as the nearest edge of the searched square, so stop once that beats the count'th candidate
+    const glm::ivec2 centreCell = getCell(centre);
+
+    for (int ring = 0;; ring++) {
+        glm::ivec2 ringMin = centreCell - ring;
+        glm::ivec2 ringMax = centreCell + ring;
+
+        if (ring == 0) {
+            forEachInCells(ringMin, ringMax, collect);
+        } else {
+            forEachInCells(ringMin, glm::ivec2(ringMax.x, ringMin.y), collect);
+            forEachInCells(glm::ivec2(ringMin.x, ringMax.y), ringMax, collect);
+            forEachInCells(glm::ivec2(ringMin.x, ringMin.y + 1),
+                           glm::ivec2(ringMin.x, ringMax.y - 1), collect);
+            forEachInCells(glm::ivec2(ringMax.x, ringMin.y + 1),
+                           glm::ivec2(ringMax.x, ringMax.y - 1), collect);
+        }
+
+        bool isEverythingSearched = ringMin.x <= minCell.x && ringMin.y <= minCell.y &&
+                                    ringMax.x >= maxCell.x && ringMax.y >= maxCell.y;
+
+        if (isEverythingSearched || candidates.size() == entries.size()) {
+            break;
+        }
+
+        if (candidates.size() >= count) {
+            int64_t edgeDistance = std::min({centre.x - ringMin.x * cellSize + 1,
+                                             (ringMax.x + 1) * cellSize - centre.x,
+                                             centre.y - ringMin.y * cellSize + 1,
+                                             (ringMax.y + 1) * cellSize - centre.y});
+
+            std::nth_element(candidates.begin(), candidates.begin() + (count - 1),
+                             candidates.end());
+
+            if (candidates[count - 1].first <= edgeDistance * edgeDistance) {
+                break;
+            }
+        }
+    }
+
+    count = std::min(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+    for (size_t i = 0; i < count; i++) {
+        results.push_back(candidates[i].second);
+    }
+}
+
+size_t SpatialIndex::getEntityCount(void) const { return entries.size(); }
+
+int SpatialIndex::getCellSize(void) const { return cellSize; }
+
+void SpatialIndex::onConstruct(entt::registry& registry, entt::entity entity) {
+    insert(entity, registry.get<Position>(entity));
+}
+
+void SpatialIndex::onUpdate(entt::registry& registry, entt::entity entity) {
+    const auto& position = registry.get<Position>(entity);
+    auto it = entries.find(entity);
+
+    if (it == entries.end()) {
+        insert(entity, position);
+        return;
+    }
+
+    // Moves within a cell only need the stored position updating
+    if (getCellKey(getCell(position)) == it->second.cell) {
+        cells[it->second.cell][it->second.slot].position = position;
+        return;
+    }
+
+    remove(entity);
+    insert(entity, position);
+}
+
+void SpatialIndex::onDestroy(entt::registry& registry, entt::entity entity) { remove(entity); }
+
+void SpatialIndex::insert(entt::entity entity, const Position& position) {
+    if (entries.contains(entity)) {
+        remove(entity);
+    }
+
+    glm::ivec2 cell = getCell(position);
+    uint64_t key = getCellKey(cell);
+    auto& cellEntities = cells[key];
+
+    entries[entity] = {key, uint32_t(cellEntities.size())};
+    cellEntities.push_back({entity, position});
+
+    if (maxCell.x < minCell.x) {
+        minCell = cell;
+        maxCell = cell;
+    } else {
+        minCell = glm::min(minCell, cell);
+        maxCell = glm::max(maxCell, cell);
+    }
+}
+
+void SpatialIndex::remove(entt::entity entity) {
+    auto it = entries.find(entity);
+
+    if (it == entries.end()) {
+        return;
+    }
+
+    auto cell = cells.find(it->second.cell);
+    auto& cellEntities = cell->second;
+    uint32_t slot = it->second.slot;
+
+    // Swap and pop, fixing up the slot of whichever entity was moved into the gap
+    if (slot + 1 != cellEntities.size()) {
+        cellEntities[slot] = cellEntities.back();
+        entries[cellEntities[slot].entity].slot = slot;
+    }
+    cellEntities.pop_back();
+
+    if (cellEntities.empty()) {
+        cells.erase(cell);
+    }
+
+    entries.erase(it);
+}
+
+template <typename Visitor>
+void SpatialIndex::forEachInCells(const glm::ivec2& minCellPosition,
+                                  const glm::ivec2& maxCellPosition, Visitor&& visitor) const {
+    const glm::ivec2 from = glm::max(minCellPosition, minCell);
+    const glm::ivec2 to = glm::min(maxCellPosition, maxCell);
+
+    for (int y = from.y; y <= to.y; y++) {
+        for (int x = from.x; x <= to.x; x++) {
+            auto cell = cells.find(getCellKey(glm::ivec2(x, y)));
+
+            if (cell == cells.end()) {
+                continue;
+            }
+
+            for (const auto& cellEntity : cell->second) {
+                visitor(cellEntity.entity, cellEntity.position);
+            }
+        }
+    }
+}
+
+glm::ivec2 SpatialIndex::getCell(const Position& position) const {
+    return glm::ivec2(floorDiv(position.x, cellSize), floorDiv(position.y, cellSize));
+}
+
+uint64_t SpatialIndex::getCellKey(const glm::ivec2& cell) {
+    return (uint64_t(uint32_t(cell.x)) << 32) | uint64_t(uint32_t(cell.y));
+}
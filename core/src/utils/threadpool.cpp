@@ -0,0 +1,95 @@
+#include "utils/threadpool.h"
+
+#include <algorithm>
+
+using namespace SpaceRogueLite::Utils;
+
+ThreadPool::ThreadPool(unsigned numThreads) {
+    numThreads = std::max(1u, numThreads);
+
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minRangeSize,
+                             const std::function<void(size_t begin, size_t end)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    size_t numRanges = std::min<size_t>(threads.size() + 1,
+                                        (count + std::max<size_t>(1, minRangeSize) - 1) /
+                                            std::max<size_t>(1, minRangeSize));
+
+    if (numRanges <= 1) {
+        body(0, count);
+        return;
+    }
+
+    size_t rangeSize = (count + numRanges - 1) / numRanges;
+    std::vector<std::future<void>> futures;
+
+    for (size_t begin = rangeSize; begin < count; begin += rangeSize) {
+        size_t end = std::min(count, begin + rangeSize);
+        futures.push_back(submit([&body, begin, end]() { body(begin, end); }));
+    }
+
+    body(0, std::min(count, rangeSize));
+
+    for (auto& future : futures) {
+        wait(future);
+    }
+}
+
+unsigned ThreadPool::getThreadCount(void) const { return static_cast<unsigned>(threads.size()); }
+
+void ThreadPool::workerLoop(void) {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (stopping && tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+    }
+}
+
+bool ThreadPool::runPendingTask(void) {
+    std::function<void()> task;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (tasks.empty()) {
+            return false;
+        }
+
+        task = std::move(tasks.front());
+        tasks.pop();
+    }
+
+    task();
+    return true;
+}
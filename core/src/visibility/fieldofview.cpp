@@ -0,0 +1,209 @@
+#include "visibility/fieldofview.h"
+
+#include <algorithm>
+
+#include "utils/threadpool.h"
+
+using namespace SpaceRogueLite;
+
+namespace {
+
+// Rational slope num / den with den > 0, kept exact so the scan is symmetric
+struct Slope {
+    int num;
+    int den;
+};
+
+struct Row {
+    int depth;
+    Slope start;
+    Slope end;
+};
+
+int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+// depth * slope rounded to the nearest column, ties rounded up
+int roundTiesUp(int depth, const Slope& slope) {
+    return floorDiv(2 * depth * slope.num + slope.den, 2 * slope.den);
+}
+
+// depth * slope rounded to the nearest column, ties rounded down
+int roundTiesDown(int depth, const Slope& slope) {
+    return -floorDiv(-(2 * depth * slope.num - slope.den), 2 * slope.den);
+}
+
+// Slope of the left edge of the tile at (depth, col)
+Slope tileSlope(int depth, int col) { return {2 * col - 1, 2 * depth}; }
+
+bool isSymmetric(const Row& row, int col) {
+    return col * row.start.den >= row.depth * row.start.num &&
+           col * row.end.den <= row.depth * row.end.num;
+}
+
+glm::ivec2 toWorld(int quadrant, const glm::ivec2& origin, int depth, int col) {
+    switch (quadrant) {
+        case 0:  // North
+            return glm::ivec2(origin.x + col, origin.y - depth);
+        case 1:  // South
+            return glm::ivec2(origin.x + col, origin.y + depth);
+        case 2:  // East
+            return glm::ivec2(origin.x + depth, origin.y + col);
+        default:  // West
+            return glm::ivec2(origin.x - depth, origin.y + col);
+    }
+}
+
+}  // namespace
+
+FieldOfView::FieldOfView(Grid& grid)
+    : grid(grid), dirtyConsumer(grid.registerDirtyConsumer()), walkability(grid.getWalkability()) {}
+
+FieldOfView::~FieldOfView() { grid.unregisterDirtyConsumer(dirtyConsumer); }
+
+void FieldOfView::setViewer(entt::entity entity, const glm::ivec2& origin, int radius) {
+    radius = std::max(0, radius);
+
+    auto [it, isNew] = viewers.try_emplace(entity, Viewer{origin, radius, true, {}});
+    auto& viewer = it->second;
+
+    if (!isNew && (viewer.origin != origin || viewer.radius != radius)) {
+        viewer.origin = origin;
+        viewer.radius = radius;
+        viewer.isDirty = true;
+    }
+}
+
+void FieldOfView::removeViewer(entt::entity entity) { viewers.erase(entity); }
+
+bool FieldOfView::hasViewer(entt::entity entity) const { return viewers.contains(entity); }
+
+void FieldOfView::update(void) {
+    markDirtyViewers();
+
+    std::vector<Viewer*> dirtyViewers;
+    for (auto& [entity, viewer] : viewers) {
+        if (viewer.isDirty) {
+            dirtyViewers.push_back(&viewer);
+        }
+    }
+
+    auto computeRange = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            compute(*dirtyViewers[i]);
+        }
+    };
+
+    if (dirtyViewers.size() >= PARALLEL_VIEWER_COUNT) {
+        Utils::getThreadPool().parallelFor(dirtyViewers.size(), PARALLEL_VIEWER_COUNT / 2,
+                                           computeRange);
+    } else {
+        computeRange(0, dirtyViewers.size());
+    }
+
+    lastRecomputeCount = dirtyViewers.size();
+}
+
+const VisibilitySet* FieldOfView::getVisibleTiles(entt::entity entity) const {
+    auto it = viewers.find(entity);
+
+    if (it == viewers.end()) {
+        return nullptr;
+    }
+
+    return &it->second.visible;
+}
+
+bool FieldOfView::isVisible(entt::entity entity, const glm::ivec2& position) const {
+    auto visible = getVisibleTiles(entity);
+    return visible != nullptr && visible->contains(position);
+}
+
+size_t FieldOfView::getLastRecomputeCount(void) const { return lastRecomputeCount; }
+
+void FieldOfView::markDirtyViewers(void) {
+    if (!grid.isDirty(dirtyConsumer)) {
+        return;
+    }
+
+    // Resizes dirty every chunk, and viewers left outside the new bounds need recomputing too
+    size_t dirtyChunkCount = 0;
+    grid.forEachDirtyChunk(dirtyConsumer, [&](int, int) { dirtyChunkCount++; });
+
+    if (dirtyChunkCount == size_t(grid.getChunkCountX()) * grid.getChunkCountY()) {
+        grid.clearDirty(dirtyConsumer);
+
+        for (auto& [entity, viewer] : viewers) {
+            viewer.isDirty = true;
+        }
+        return;
+    }
+
+    grid.consumeDirtyChunks(dirtyConsumer, [this](int chunkX, int chunkY) {
+        GridRegion chunk = {chunkX * Grid::CHUNK_SIZE, chunkY * Grid::CHUNK_SIZE, Grid::CHUNK_SIZE,
+                            Grid::CHUNK_SIZE};
+
+        for (auto& [entity, viewer] : viewers) {
+            if (viewer.origin.x + viewer.radius >= chunk.x &&
+                viewer.origin.x - viewer.radius < chunk.x + chunk.width &&
+                viewer.origin.y + viewer.radius >= chunk.y &&
+                viewer.origin.y - viewer.radius < chunk.y + chunk.height) {
+                viewer.isDirty = true;
+            }
+        }
+    });
+}
+
+void FieldOfView::compute(Viewer& viewer) const {
+    // Symmetric shadowcasting, see https://www.albertford.com/shadowcasting/
+    thread_local std::vector<Row> rows;
+
+    const int radius = viewer.radius;
+    auto& visible = viewer.visible;
+
+    visible.reset(viewer.origin, radius);
+    visible.set(viewer.origin);
+
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        rows.push_back({1, {-1, 1}, {1, 1}});
+
+        while (!rows.empty()) {
+            Row row = rows.back();
+            rows.pop_back();
+
+            if (row.depth > radius) {
+                continue;
+            }
+
+            int minCol = roundTiesUp(row.depth, row.start);
+            int maxCol = roundTiesDown(row.depth, row.end);
+
+            enum { NONE, FLOOR, WALL } previous = NONE;
+
+            for (int col = minCol; col <= maxCol; col++) {
+                glm::ivec2 position = toWorld(quadrant, viewer.origin, row.depth, col);
+                bool isWall = !walkability.isWalkable(position.x, position.y);
+                bool isInRadius = row.depth * row.depth + col * col <= radius * radius + radius;
+
+                if ((isWall || isSymmetric(row, col)) && isInRadius) {
+                    visible.set(position);
+                }
+
+                if (previous == WALL && !isWall) {
+                    row.start = tileSlope(row.depth, col);
+                }
+
+                if (previous == FLOOR && isWall) {
+                    rows.push_back({row.depth + 1, row.start, tileSlope(row.depth, col)});
+                }
+
+                previous = isWall ? WALL : FLOOR;
+            }
+
+            if (previous == FLOOR) {
+                rows.push_back({row.depth + 1, row.start, row.end});
+            }
+        }
+    }
+
+    viewer.isDirty = false;
+}
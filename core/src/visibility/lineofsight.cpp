@@ -0,0 +1,255 @@
+#include "visibility/lineofsight.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "utils/threadpool.h"
+
+using namespace SpaceRogueLite;
+
+LineOfSight::LineOfSight(Grid& grid)
+    : grid(grid), dirtyConsumer(grid.registerDirtyConsumer()), walkability(grid.getWalkability()) {}
+
+LineOfSight::~LineOfSight() { grid.unregisterDirtyConsumer(dirtyConsumer); }
+
+void LineOfSight::update(void) {
+    if (!grid.isDirty(dirtyConsumer)) {
+        return;
+    }
+
+    std::vector<glm::ivec2> dirtyChunks;
+
+    grid.consumeDirtyChunks(dirtyConsumer, [&](int chunkX, int chunkY) {
+        dirtyChunks.push_back(glm::ivec2(chunkX, chunkY));
+    });
+
+    // Resizes and bulk tile changes dirty every chunk, cheaper to start over
+    if (dirtyChunks.size() == size_t(grid.getChunkCountX()) * grid.getChunkCountY()) {
+        clearCache();
+        return;
+    }
+
+    invalidateChunks(dirtyChunks);
+}
+
+bool LineOfSight::hasLineOfSight(const glm::ivec2& from, const glm::ivec2& to) {
+    return query({{from, to}})[0] & 1;
+}
+
+std::vector<uint64_t> LineOfSight::query(const std::vector<LineOfSightQuery>& queries) {
+    update();
+
+    std::vector<uint64_t> visibility((queries.size() + 63) / 64, 0);
+    std::vector<LineOfSightQuery> misses;
+    std::vector<size_t> missIndices;
+
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto canonical = getCanonicalQuery(queries[i]);
+
+        if (cachingEnabled) {
+            auto bucket = cache.find(getBucketKey(canonical));
+
+            if (bucket != cache.end()) {
+                auto result = bucket->second.results.find(canonical);
+
+                if (result != bucket->second.results.end()) {
+                    visibility[i / 64] |= uint64_t(result->second) << (i % 64);
+                    continue;
+                }
+            }
+        }
+
+        misses.push_back(canonical);
+        missIndices.push_back(i);
+    }
+
+    std::vector<uint8_t> results(misses.size(), 0);
+    auto trace = [&](size_t begin, size_t end) {
+        traceQueries(misses.data() + begin, end - begin, results.data() + begin);
+    };
+
+    if (misses.size() >= PARALLEL_BATCH_SIZE) {
+        Utils::getThreadPool().parallelFor(misses.size(), PARALLEL_BATCH_SIZE, trace);
+    } else {
+        trace(0, misses.size());
+    }
+
+    for (size_t i = 0; i < misses.size(); i++) {
+        visibility[missIndices[i] / 64] |= uint64_t(results[i]) << (missIndices[i] % 64);
+
+        if (!cachingEnabled) {
+            continue;
+        }
+
+        if (cachedResultCount >= MAX_CACHED_RESULTS) {
+            clearCache();
+        }
+
+        auto [bucket, isNewBucket] = cache.try_emplace(getBucketKey(misses[i]));
+        if (isNewBucket) {
+            auto fromChunk = misses[i].from / Grid::CHUNK_SIZE;
+            auto toChunk = misses[i].to / Grid::CHUNK_SIZE;
+            bucket->second.minChunk = glm::min(fromChunk, toChunk);
+            bucket->second.maxChunk = glm::max(fromChunk, toChunk);
+        }
+
+        if (bucket->second.results.emplace(misses[i], results[i] != 0).second) {
+            cachedResultCount++;
+        }
+    }
+
+    return visibility;
+}
+
+void LineOfSight::setCachingEnabled(bool enabled) {
+    cachingEnabled = enabled;
+
+    if (!cachingEnabled) {
+        clearCache();
+    }
+}
+
+void LineOfSight::clearCache(void) {
+    cache.clear();
+    cachedResultCount = 0;
+}
+
+size_t LineOfSight::getCachedResultCount(void) const { return cachedResultCount; }
+
+const WalkabilityBitmap& LineOfSight::getWalkability(void) const { return walkability; }
+
+void LineOfSight::traceQueries(const LineOfSightQuery* queries, size_t count,
+                               uint8_t* results) const {
+    for (size_t i = 0; i < count; i += PACKET_SIZE) {
+        tracePacket(queries + i, std::min(PACKET_SIZE, count - i), results + i);
+    }
+}
+
+void LineOfSight::tracePacket(const LineOfSightQuery* queries, size_t count,
+                              uint8_t* results) const {
+    // Rays are stepped in lockstep, one lane per ray, using the integer form of the THIN traversal
+    // in traverseGrid. With tile centre end points the distance to the next boundary after k steps
+    // is (k + 0.5) cells, so comparing (2k + 1) * |d| on each axis is exact. The products are 64
+    // bit as they overflow 32 bits once rays pass around 32k tiles. The fixed width lane
+    // loops below are branch free apart from the bitmap lookup so they vectorise
+    int32_t fromX[PACKET_SIZE], fromY[PACKET_SIZE];
+    int32_t stepX[PACKET_SIZE], stepY[PACKET_SIZE];
+    int32_t absDx[PACKET_SIZE], absDy[PACKET_SIZE];
+    int32_t stepsX[PACKET_SIZE], stepsY[PACKET_SIZE];
+    uint8_t active[PACKET_SIZE], visible[PACKET_SIZE];
+
+    const uint64_t* words = walkability.getWords().data();
+    const int32_t wordsPerRow = walkability.getWordsPerRow();
+    const int32_t width = walkability.getWidth();
+    const int32_t height = walkability.getHeight();
+
+    if (width == 0 || height == 0) {
+        std::fill(results, results + count, 0);
+        return;
+    }
+
+    for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+        LineOfSightQuery query = lane < count ? queries[lane] : LineOfSightQuery{};
+
+        bool inBounds = query.from.x >= 0 && query.from.y >= 0 && query.to.x >= 0 &&
+                        query.to.y >= 0 && query.from.x < width && query.to.x < width &&
+                        query.from.y < height && query.to.y < height;
+
+        // Idle lanes sit on (0, 0) with no steps left, keeping their bitmap reads in bounds
+        if (!inBounds) {
+            query = {};
+        }
+
+        int32_t dx = query.to.x - query.from.x;
+        int32_t dy = query.to.y - query.from.y;
+
+        fromX[lane] = query.from.x;
+        fromY[lane] = query.from.y;
+        stepX[lane] = dx > 0 ? 1 : (dx < 0 ? -1 : 0);
+        stepY[lane] = dy > 0 ? 1 : (dy < 0 ? -1 : 0);
+        absDx[lane] = std::abs(dx);
+        absDy[lane] = std::abs(dy);
+        stepsX[lane] = 0;
+        stepsY[lane] = 0;
+        visible[lane] = inBounds;
+        active[lane] = inBounds && (dx != 0 || dy != 0);
+    }
+
+    bool anyActive = true;
+    while (anyActive) {
+        uint8_t activeMask = 0;
+
+        for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+            int64_t crossX = (2 * int64_t(stepsX[lane]) + 1) * absDy[lane];
+            int64_t crossY = (2 * int64_t(stepsY[lane]) + 1) * absDx[lane];
+
+            int32_t moveX = stepsX[lane] < absDx[lane] &&
+                            (stepsY[lane] == absDy[lane] || crossX <= crossY);
+            int32_t moveY = stepsY[lane] < absDy[lane] &&
+                            (stepsX[lane] == absDx[lane] || crossY <= crossX);
+
+            stepsX[lane] += moveX & active[lane];
+            stepsY[lane] += moveY & active[lane];
+
+            int32_t x = fromX[lane] + stepX[lane] * stepsX[lane];
+            int32_t y = fromY[lane] + stepY[lane] * stepsY[lane];
+            uint8_t reachedEnd = stepsX[lane] == absDx[lane] && stepsY[lane] == absDy[lane];
+
+            uint8_t walkable = (words[y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+            uint8_t blocked = active[lane] & !reachedEnd & !walkable;
+
+            visible[lane] &= !blocked;
+            active[lane] &= !reachedEnd & !blocked;
+            activeMask |= active[lane];
+        }
+
+        anyActive = activeMask != 0;
+    }
+
+    for (size_t lane = 0; lane < count; lane++) {
+        results[lane] = visible[lane];
+    }
+}
+
+void LineOfSight::invalidateChunks(const std::vector<glm::ivec2>& dirtyChunks) {
+    if (dirtyChunks.empty() || cache.empty()) {
+        return;
+    }
+
+    for (auto it = cache.begin(); it != cache.end();) {
+        const auto& bucket = it->second;
+
+        bool isAffected = std::any_of(
+            dirtyChunks.begin(), dirtyChunks.end(), [&bucket](const glm::ivec2& chunk) {
+                return chunk.x >= bucket.minChunk.x && chunk.x <= bucket.maxChunk.x &&
+                       chunk.y >= bucket.minChunk.y && chunk.y <= bucket.maxChunk.y;
+            });
+
+        if (isAffected) {
+            cachedResultCount -= bucket.results.size();
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+LineOfSightQuery LineOfSight::getCanonicalQuery(const LineOfSightQuery& query) {
+    // The THIN traversal is symmetric, so (a, b) and (b, a) can share a cache entry
+    bool isOrdered =
+        query.from.x < query.to.x || (query.from.x == query.to.x && query.from.y <= query.to.y);
+
+    return isOrdered ? query : LineOfSightQuery{query.to, query.from};
+}
+
+LineOfSightQuery LineOfSight::getBucketKey(const LineOfSightQuery& query) {
+    return {query.from / Grid::CHUNK_SIZE, query.to / Grid::CHUNK_SIZE};
+}
+
+size_t LineOfSight::QueryHash::operator()(const LineOfSightQuery& query) const {
+    uint64_t from = (uint64_t(uint32_t(query.from.x)) << 32) | uint32_t(query.from.y);
+    uint64_t to = (uint64_t(uint32_t(query.to.x)) << 32) | uint32_t(query.to.y);
+
+    uint64_t hash = (from ^ (to * 0x9e3779b97f4a7c15)) * 0xbf58476d1ce4e5b9;
+    return static_cast<size_t>(hash ^ (hash >> 31));
+}
@@ -0,0 +1,14 @@
+#include "walkabilitybitmap.h"
+
+#include <algorithm>
+
+using namespace SpaceRogueLite;
+
+WalkabilityBitmap::WalkabilityBitmap(int width, int height) { resize(width, height); }
+
+void WalkabilityBitmap::resize(int newWidth, int newHeight) {
+    width = std::max(0, newWidth);
+    height = std::max(0, newHeight);
+    wordsPerRow = (width + 63) / 64;
+    words.assign(wordsPerRow * height, 0);
+}
@@ -0,0 +1,365 @@
+#include "walkableregions.h"
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+using namespace SpaceRogueLite;
+
+void WalkableRegions::invalidate(void) { needsRelabel = true; }
+
+void WalkableRegions::onWalkabilityChanged(const WalkabilityBitmap& walkability, int x, int y) {
+    if (needsRelabel || walkability.getWidth() != width || walkability.getHeight() != height) {
+        needsRelabel = true;
+        return;
+    }
+
+    const int32_t tile = y * width + x;
+    const int32_t region = labels[tile];
+
+    if (walkability.isWalkable(x, y)) {
+        if (region == NO_REGION) {
+            onTileWalkable(walkability, tile);
+        }
+    } else if (region != NO_REGION) {
+        onTileBlocked(walkability, tile, region);
+    }
+}
+
+void WalkableRegions::update(const WalkabilityBitmap& walkability) {
+    if (needsRelabel) {
+        relabel(walkability);
+    }
+}
+
+bool WalkableRegions::isUpToDate(void) const { return !needsRelabel; }
+
+int32_t WalkableRegions::getRegion(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        return NO_REGION;
+    }
+
+    return labels[y * width + x];
+}
+
+size_t WalkableRegions::getRegionCount(void) const { return regionCount; }
+
+void WalkableRegions::relabel(const WalkabilityBitmap& walkability) {
+    width = walkability.getWidth();
+    height = walkability.getHeight();
+    labels.assign(size_t(width) * height, NO_REGION);
+    regionSizes.clear();
+    freeRegionIds.clear();
+    regionCount = 0;
+
+    // Union-find over a single raster pass, joining each walkable tile to its left and upper
+    // neighbours, then the roots are numbered into region ids
+    std::vector<int32_t> parents(labels.size(), NO_REGION);
+
+    auto find = [&parents](int32_t tile) {
+        int32_t root = tile;
+        while (parents[root] != root) {
+            root = parents[root];
+        }
+
+        while (parents[tile] != root) {
+            int32_t next = parents[tile];
+            parents[tile] = root;
+            tile = next;
+        }
+
+        return root;
+    };
+
+    auto unite = [&](int32_t a, int32_t b) {
+        a = find(a);
+        b = find(b);
+
+        if (a != b) {
+            parents[std::max(a, b)] = std::min(a, b);
+        }
+    };
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!walkability.isWalkable(x, y)) {
+                continue;
+            }
+
+            const int32_t tile = y * width + x;
+            parents[tile] = tile;
+
+            if (x > 0 && parents[tile - 1] != NO_REGION) {
+                unite(tile, tile - 1);
+            }
+
+            if (y > 0 && parents[tile - width] != NO_REGION) {
+                unite(tile, tile - width);
+            }
+        }
+    }
+
+    // Roots have the lowest index in their region, so they're numbered before the rest of it
+    for (int32_t tile = 0; tile < int32_t(labels.size()); tile++) {
+        if (parents[tile] == NO_REGION) {
+            continue;
+        }
+
+        int32_t root = find(tile);
+        labels[tile] = root == tile ? createRegion() : labels[root];
+        regionSizes[labels[tile]]++;
+    }
+
+    needsRelabel = false;
+}
+
+void WalkableRegions::onTileWalkable(const WalkabilityBitmap& walkability, int32_t tile) {
+    int32_t neighbours[4];
+    const int count = getWalkableNeighbours(walkability, tile, neighbours);
+
+    // The largest region keeps its label, so only the smaller ones are walked
+    int32_t kept = NO_REGION;
+    for (int i = 0; i < count; i++) {
+        int32_t region = labels[neighbours[i]];
+
+        if (kept == NO_REGION || regionSizes[region] > regionSizes[kept]) {
+            kept = region;
+        }
+    }
+
+    if (kept == NO_REGION) {
+        kept = createRegion();
+    }
+
+    labels[tile] = kept;
+    regionSizes[kept]++;
+
+    std::vector<int32_t> pending;
+
+    for (int i = 0; i < count; i++) {
+        const int32_t region = labels[neighbours[i]];
+
+        if (region == kept) {
+            continue;
+        }
+
+        labels[neighbours[i]] = kept;
+        pending.push_back(neighbours[i]);
+
+        while (!pending.empty()) {
+            int32_t current = pending.back();
+            pending.pop_back();
+
+            int32_t next[4];
+            const int nextCount = getWalkableNeighbours(walkability, current, next);
+
+            for (int j = 0; j < nextCount; j++) {
+                if (labels[next[j]] == region) {
+                    labels[next[j]] = kept;
+                    pending.push_back(next[j]);
+                }
+            }
+        }
+
+        regionSizes[kept] += regionSizes[region];
+        releaseRegion(region);
+    }
+}
+
+void WalkableRegions::onTileBlocked(const WalkabilityBitmap& walkability, int32_t tile,
+                                    int32_t region) {
+    labels[tile] = NO_REGION;
+    regionSizes[region]--;
+
+    int32_t neighbours[4];
+    const int count = getWalkableNeighbours(walkability, tile, neighbours);
+
+    if (count == 0) {
+        releaseRegion(region);
+        return;
+    }
+
+    if (count == 1 || areNeighboursJoinedLocally(walkability, tile)) {
+        return;
+    }
+
+    // A breadth first search from each neighbour, stepped in turn. Searches which meet are on the
+    // same piece and are grouped together. Once all but one group has run out of tiles, those
+    // groups are the pieces cut off, and each was only searched about as far as the smallest
+    struct Search {
+        std::vector<int32_t> visited;  // Also the queue, from next onwards
+        size_t next = 0;
+        int group;
+    };
+
+    std::array<Search, 4> searches;
+    std::unordered_map<int32_t, int> visitedBy;  // Tile to the search which reached it
+
+    for (int i = 0; i < count; i++) {
+        searches[i].visited.push_back(neighbours[i]);
+        searches[i].group = i;
+        visitedBy.emplace(neighbours[i], i);
+    }
+
+    while (true) {
+        std::array<bool, 4> isGroup = {}, isRunning = {};
+
+        for (int i = 0; i < count; i++) {
+            isGroup[searches[i].group] = true;
+            isRunning[searches[i].group] |= searches[i].next < searches[i].visited.size();
+        }
+
+        int groupCount = std::count(isGroup.begin(), isGroup.end(), true);
+        int runningCount = std::count(isRunning.begin(), isRunning.end(), true);
+
+        // Every neighbour is still joined up, the region hasn't split
+        if (groupCount == 1) {
+            return;
+        }
+
+        if (runningCount <= 1) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            auto& search = searches[i];
+
+            if (search.next == search.visited.size()) {
+                continue;
+            }
+
+            int32_t next[4];
+            const int nextCount =
+                getWalkableNeighbours(walkability, search.visited[search.next++], next);
+
+            for (int j = 0; j < nextCount; j++) {
+                auto [visited, isNew] = visitedBy.emplace(next[j], i);
+
+                if (isNew) {
+                    search.visited.push_back(next[j]);
+                    continue;
+                }
+
+                const int other = searches[visited->second].group;
+                if (other != search.group) {
+                    for (int k = 0; k < count; k++) {
+                        if (searches[k].group == other) {
+                            searches[k].group = search.group;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // The group still running keeps the region's label. If every group finished together, the
+    // largest one keeps it
+    std::array<int32_t, 4> groupSizes = {};
+    std::array<bool, 4> isRunning = {};
+
+    for (int i = 0; i < count; i++) {
+        groupSizes[searches[i].group] += int32_t(searches[i].visited.size());
+        isRunning[searches[i].group] |= searches[i].next < searches[i].visited.size();
+    }
+
+    int keptGroup = searches[0].group;
+    for (int i = 0; i < count; i++) {
+        int group = searches[i].group;
+
+        if (isRunning[group] ||
+            (!isRunning[keptGroup] && groupSizes[group] > groupSizes[keptGroup])) {
+            keptGroup = group;
+        }
+    }
+
+    for (int group = 0; group < count; group++) {
+        if (group == keptGroup || groupSizes[group] == 0) {
+            continue;
+        }
+
+        const int32_t newRegion = createRegion();
+
+        for (int i = 0; i < count; i++) {
+            if (searches[i].group != group) {
+                continue;
+            }
+
+            for (auto visited : searches[i].visited) {
+                labels[visited] = newRegion;
+            }
+        }
+
+        regionSizes[newRegion] = groupSizes[group];
+        regionSizes[region] -= groupSizes[group];
+    }
+}
+
+int32_t WalkableRegions::createRegion(void) {
+    regionCount++;
+
+    if (!freeRegionIds.empty()) {
+        int32_t region = freeRegionIds.back();
+        freeRegionIds.pop_back();
+        return region;
+    }
+
+    regionSizes.push_back(0);
+    return int32_t(regionSizes.size()) - 1;
+}
+
+void WalkableRegions::releaseRegion(int32_t region) {
+    regionSizes[region] = 0;
+    freeRegionIds.push_back(region);
+    regionCount--;
+}
+
+int WalkableRegions::getWalkableNeighbours(const WalkabilityBitmap& walkability, int32_t tile,
+                                           int32_t neighbours[4]) const {
+    const int x = tile % width;
+    const int y = tile / width;
+    int count = 0;
+
+    if (walkability.isWalkable(x + 1, y)) {
+        neighbours[count++] = tile + 1;
+    }
+    if (walkability.isWalkable(x - 1, y)) {
+        neighbours[count++] = tile - 1;
+    }
+    if (walkability.isWalkable(x, y + 1)) {
+        neighbours[count++] = tile + width;
+    }
+    if (walkability.isWalkable(x, y - 1)) {
+        neighbours[count++] = tile - width;
+    }
+
+    return count;
+}
+
+bool WalkableRegions::areNeighboursJoinedLocally(const WalkabilityBitmap& walkability,
+                                                 int32_t tile) const {
+    // The ring of tiles around tile, clockwise from above. Even entries are the 4-neighbours, and
+    // each corner joins the two neighbours either side of it
+    static constexpr int RING[8][2] = {{0, -1}, {1, -1}, {1, 0},  {1, 1},
+                                       {0, 1},  {-1, 1}, {-1, 0}, {-1, -1}};
+
+    const int x = tile % width;
+    const int y = tile / width;
+
+    std::array<bool, 8> isWalkable;
+    for (int i = 0; i < 8; i++) {
+        isWalkable[i] = walkability.isWalkable(x + RING[i][0], y + RING[i][1]);
+    }
+
+    int neighbourCount = 0;
+    int joinCount = 0;
+
+    for (int i = 0; i < 8; i += 2) {
+        if (isWalkable[i]) {
+            neighbourCount++;
+            joinCount += isWalkable[i + 1] && isWalkable[(i + 2) % 8];
+        }
+    }
+
+    // The joins form a cycle when all four neighbours and corners are walkable
+    return neighbourCount - std::min(joinCount, neighbourCount - 1) <= 1;
+}
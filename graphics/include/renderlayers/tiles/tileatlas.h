@@ -8,7 +8,6 @@
 
 #include <glm/glm.hpp>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 namespace SpaceRogueLite {
@@ -50,7 +49,7 @@ private:
     std::vector<glm::vec4> tileUVs;
     uint32_t nextSlot = 1;
 
-    std::unordered_map<TileVariantKey, std::vector<TileAtlasVariant>, TileVariantKeyHash> variants;
+    std::vector<std::vector<TileAtlasVariant>> variants;  // Indexed by TileVariantId
 
     static constexpr uint32_t ATLAS_SIZE = 1024;
     static constexpr uint32_t TILES_PER_ROW = ATLAS_SIZE / TILE_SIZE;
@@ -2,6 +2,7 @@
 #include <SDL3/SDL.h>
 
 #include <grid.h>
+#include <gridsnapshot.h>
 #include <tilevariant.h>
 #include <entt/entt.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -42,7 +43,7 @@ public:
     void invalidateCache();
 
 private:
-    static constexpr int CHUNK_SIZE_TILES = 16;
+    static constexpr int CHUNK_SIZE_TILES = Grid::CHUNK_SIZE;
     static constexpr int CHUNK_SIZE_PIXELS = CHUNK_SIZE_TILES * TILE_SIZE;  // 512
 
     struct TileChunk {
@@ -102,6 +103,7 @@ private:
     glm::ivec2 cachedGridSize{0, 0};
     glm::ivec2 chunkGridSize{0, 0};
     bool cacheValid = false;
+    std::shared_ptr<const GridSnapshot> gridSnapshot;  // Everything is rebaked from this
 
     glm::vec2 cachedCameraPos{-1.0f, -1.0f};
     glm::vec2 cachedCameraSize{0.0f, 0.0f};
@@ -122,7 +124,7 @@ private:
     uint32_t allocateLayerIndex();
     void freeLayerIndex(uint32_t index);
 
-    void updateChunkGrid();
+    void updateChunkGrid(const GridSnapshot& snapshot);
     void createAllChunks();
     TileChunk& getOrCreateChunk(glm::ivec2 chunkPos);
     void destroyChunk(const TileChunk& chunk);
@@ -130,7 +132,7 @@ private:
 
     glm::ivec2 calculateChunkTileCount(glm::ivec2 chunkPos) const;
 
-    void markDirtyChunksFromRegion(const GridRegion& dirtyRegion);
+    void markDirtyChunk(glm::ivec2 chunkPos);
 
     void updateVisibleChunks(const Camera& camera);
 
@@ -72,7 +72,10 @@ bool TileAtlas::loadTileVariant(const TileVariant& variant) {
         return false;
     }
 
-    variants[{variant.tileId, variant.type}] = std::move(tileVariants);
+    if (variant.variant >= variants.size()) {
+        variants.resize(variant.variant + 1);
+    }
+    variants[variant.variant] = std::move(tileVariants);
 
     SDL_DestroySurface(surface);
     return true;
@@ -152,16 +155,14 @@ std::vector<TileAtlas::TileAtlasVariant> TileAtlas::loadRotatableTile(SDL_Surfac
 }
 
 glm::vec4 TileAtlas::getTileUV(const GridTile& tile) const {
-    auto it = variants.find({tile.id, tile.type});
-
-    if (it == variants.end()) {
+    if (tile.variant >= variants.size() || variants[tile.variant].empty()) {
         spdlog::warn(
-            "TileAtlas::getTileUV: TileId {} with type '{}' not found, returning empty UVs",
-            tile.id, tile.type);
+            "TileAtlas::getTileUV: TileId {} with variant {} not found, returning empty UVs",
+            tile.id, tile.variant);
         return glm::vec4(0.0f);
     }
 
-    const auto& tileVariants = it->second;
+    const auto& tileVariants = variants[tile.variant];
     size_t index = tile.orientation % tileVariants.size();
 
     return tileUVs[tileVariants[index].slot];
@@ -48,6 +48,8 @@ void TileRenderer::shutdown() {
 
     destroyAllChunks();
 
+    gridSnapshot.reset();
+
     if (chunkSampler) {
         SDL_ReleaseGPUSampler(device, chunkSampler);
         chunkSampler = nullptr;
@@ -129,19 +131,24 @@ void TileRenderer::prepareFrame(SDL_GPUCommandBuffer* commandBuffer) {
         return;
     }
 
-    updateChunkGrid();
+    // Baking only reads the snapshot, so it doesn't race with whatever is writing the grid
+    auto snapshot = grid.createSnapshot();
+
+    updateChunkGrid(*snapshot);
 
-    if (!cacheValid) {
+    if (!cacheValid || !gridSnapshot) {
         for (auto& [coord, chunk] : chunks) {
             chunk.isDirty = true;
         }
 
         cacheValid = true;
-    } else if (grid.isDirty()) {
-        markDirtyChunksFromRegion(grid.getDirtyRegion());
+    } else if (snapshot != gridSnapshot) {
+        snapshot->forEachChangedChunk(*gridSnapshot, [this](int chunkX, int chunkY) {
+            markDirtyChunk(glm::ivec2(chunkX, chunkY));
+        });
     }
 
-    grid.clearDirty();
+    gridSnapshot = std::move(snapshot);
 
     rebakeDirtyChunks(commandBuffer);
     uploadChunkInstances(commandBuffer);
@@ -524,13 +531,8 @@ uint32_t TileRenderer::allocateLayerIndex() {
 
 void TileRenderer::freeLayerIndex(uint32_t index) { freeLayerIndices.push_back(index); }
 
-void TileRenderer::updateChunkGrid() {
-    if (!entt::locator<Grid>::has_value()) {
-        return;
-    }
-
-    auto& grid = entt::locator<Grid>::value();
-    glm::ivec2 gridSize(grid.getWidth(), grid.getHeight());
+void TileRenderer::updateChunkGrid(const GridSnapshot& snapshot) {
+    glm::ivec2 gridSize(snapshot.getWidth(), snapshot.getHeight());
 
     if (gridSize == cachedGridSize) {
         return;
@@ -618,27 +620,11 @@ glm::ivec2 TileRenderer::calculateChunkTileCount(glm::ivec2 chunkPos) const {
     return endTile - startTile;
 }
 
-void TileRenderer::markDirtyChunksFromRegion(const GridRegion& region) {
-    if (region.width <= 0 || region.height <= 0) {
-        return;
-    }
-
-    glm::ivec2 startChunk = glm::ivec2(region.x, region.y) / CHUNK_SIZE_TILES;
-    glm::ivec2 endChunk =
-        (glm::ivec2(region.x + region.width, region.y + region.height) - 1) / CHUNK_SIZE_TILES;
-
-    startChunk = glm::max(startChunk, glm::ivec2(0));
-    endChunk = glm::min(endChunk, chunkGridSize - 1);
-
-    for (int cy = startChunk.y; cy <= endChunk.y; ++cy) {
-        for (int cx = startChunk.x; cx <= endChunk.x; ++cx) {
-            glm::ivec2 coord(cx, cy);
-            auto it = chunks.find(coord);
+void TileRenderer::markDirtyChunk(glm::ivec2 chunkPos) {
+    auto it = chunks.find(chunkPos);
 
-            if (it != chunks.end()) {
-                it->second.isDirty = true;
-            }
-        }
+    if (it != chunks.end()) {
+        it->second.isDirty = true;
     }
 }
 
@@ -756,14 +742,13 @@ bool TileRenderer::ensureChunkInstanceBuffer(uint32_t chunkCount) {
 }
 
 void TileRenderer::rebakeChunk(SDL_GPUCommandBuffer* commandBuffer, TileChunk& chunk) {
-    if (!entt::locator<Grid>::has_value()) {
+    if (!gridSnapshot) {
         return;
     }
 
-    const auto& grid = entt::locator<Grid>::value();
+    const auto& grid = *gridSnapshot;
 
     glm::ivec2 startTile = chunk.chunkPos * CHUNK_SIZE_TILES;
-    glm::ivec2 endTile = startTile + chunk.tileCount;
 
     uint32_t maxTiles = chunk.tileCount.x * chunk.tileCount.y;
     if (!ensureTileInstanceBuffer(maxTiles)) {
@@ -774,19 +759,17 @@ void TileRenderer::rebakeChunk(SDL_GPUCommandBuffer* commandBuffer, TileChunk& c
         static_cast<TileInstance*>(SDL_MapGPUTransferBuffer(device, tileInstanceTransfer, true));
 
     uint32_t instanceIdx = 0;
-    for (int y = startTile.y; y < endTile.y; ++y) {
-        for (int x = startTile.x; x < endTile.x; ++x) {
-            GridTile tile = grid.getTile(x, y);
-
-            if (tile.id != TILE_EMPTY) {
-                int localX = x - startTile.x;
-                int localY = y - startTile.y;
-                instances[instanceIdx].position = glm::vec2(localX * TILE_SIZE, localY * TILE_SIZE);
-                instances[instanceIdx].uvBounds = atlas->getTileUV(tile);
-                instanceIdx++;
-            }
+    GridRegion region = {startTile.x, startTile.y, chunk.tileCount.x, chunk.tileCount.y};
+
+    grid.forEachTile(region, [&](int x, int y, const GridTile& tile) {
+        if (tile.id != TILE_EMPTY) {
+            int localX = x - startTile.x;
+            int localY = y - startTile.y;
+            instances[instanceIdx].position = glm::vec2(localX * TILE_SIZE, localY * TILE_SIZE);
+            instances[instanceIdx].uvBounds = atlas->getTileUV(tile);
+            instanceIdx++;
         }
-    }
+    });
 
     SDL_UnmapGPUTransferBuffer(device, tileInstanceTransfer);
 
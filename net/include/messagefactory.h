@@ -1,6 +1,8 @@
 #pragma once
 
 #include <yojimbo.h>
+#include <cstring>
+#include <vector>
 
 #include "connectionconfig.h"
 #include "message.h"
@@ -12,9 +14,10 @@ namespace SpaceRogueLite {
 // ============================================================================
 // Add new messages here
 // Format: X(ENUM_NAME, MessageClass)
-#define MESSAGE_LIST(X)  \
-    X(PING, PingMessage) \
-    X(SPAWN_ACTOR, SpawnActorMessage)
+#define MESSAGE_LIST(X)               \
+    X(PING, PingMessage)              \
+    X(SPAWN_ACTOR, SpawnActorMessage) \
+    X(GRID_DELTA, GridDeltaMessage)
 
 enum class MessageType {
 #define MESSAGE_ENUM(name, messageClass) name,
@@ -101,6 +104,53 @@ public:
     YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
 };
 
+class GridDeltaMessage : public Message {
+public:
+    // Deltas are encoded to fit (see GridDelta), keeping each message well inside a packet
+    static constexpr int MAX_DELTA_BYTES = 2048;
+
+    GridDeltaMessage() : Message(MessageChannel::RELIABLE) {}
+
+    constexpr const char* getName() const override { return "GridDelta"; }
+
+    uint8_t delta[MAX_DELTA_BYTES];
+    int deltaSize = 0;
+
+    std::string toString(void) const {
+        return std::string(getName()) + ": " + std::to_string(deltaSize) + " bytes";
+    }
+
+    bool parseFromCommand(const std::vector<std::string>& args) override {
+        spdlog::warn("GridDeltaMessage is sent by the server and can't be sent from a command");
+        return false;
+    }
+
+    bool parse(const std::vector<uint8_t>& bytes) {
+        if (bytes.empty() || bytes.size() > MAX_DELTA_BYTES) {
+            spdlog::warn("Grid delta of {} bytes doesn't fit, must be between 1 and {}",
+                         bytes.size(), MAX_DELTA_BYTES);
+            return false;
+        }
+
+        std::memcpy(delta, bytes.data(), bytes.size());
+        deltaSize = static_cast<int>(bytes.size());
+        return true;
+    }
+
+    std::string getCommandHelpText(void) const override {
+        return "Grid changes sent from the server to clients.";
+    }
+
+    template <typename Stream>
+    bool Serialize(Stream& stream) {
+        serialize_int(stream, deltaSize, 1, MAX_DELTA_BYTES);
+        serialize_bytes(stream, delta, deltaSize);
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
 YOJIMBO_MESSAGE_FACTORY_START(GameMessageFactory, (int) MessageType::COUNT);
 #define MESSAGE_FACTORY_REGISTER(name, messageClass) \
     YOJIMBO_DECLARE_MESSAGE_TYPE((int) MessageType::name, messageClass);
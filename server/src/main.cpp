@@ -4,15 +4,20 @@
 
 #include "actorspawner.h"
 #include "game.h"
+#include "generation/wfc/wfctileset.h"
+#include "grid.h"
+#include "gridfile.h"
+#include "net/gridreplicator.h"
 #include "net/server.h"
 #include "net/servermessagehandler.h"
+#include "net/servermessagetransmitter.h"
 
 struct Position {
     float x;
     float y;
 };
 
-int main() {
+int main(int argc, char* argv[]) {
 #if !defined(NDEBUG)
     spdlog::set_level(spdlog::level::trace);
     // yojimbo_log_level(YOJIMBO_LOG_LEVEL_DEBUG);
@@ -37,6 +42,25 @@ int main() {
 
     server.start();
 
+    // Clients are sent the map given on the command line and kept up to date with its changes.
+    // Without one they generate their own
+    SpaceRogueLite::ServerMessageTransmitter messageTransmitter(server);
+    SpaceRogueLite::Grid grid(0, 0);
+    SpaceRogueLite::GridReplicator gridReplicator(grid, server, messageTransmitter);
+
+    if (argc > 1) {
+        SpaceRogueLite::WFCTileSet tileSet("../../../assets/tilesets/grass_and_rocks/rules.json");
+        tileSet.load();
+
+        SpaceRogueLite::GridFile mapFile;
+        if (mapFile.open(argv[1], tileSet.getVariantTable()) && mapFile.loadInto(grid)) {
+            spdlog::info("Serving {}x{} map from {}", grid.getWidth(), grid.getHeight(), argv[1]);
+
+            game.attachWorker({2, "GridReplication",
+                               [&gridReplicator](int64_t timeSinceLastFrame, bool& quit) { gridReplicator.update(); }});
+        }
+    }
+
     SpaceRogueLite::ActorSpawner spawner(registry, dispatcher);
     SpaceRogueLite::ActorSystem actorSystem(registry, dispatcher);
 
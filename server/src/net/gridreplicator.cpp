@@ -0,0 +1,63 @@
+#include "gridreplicator.h"
+
+#include "griddelta.h"
+
+using namespace SpaceRogueLite;
+
+static_assert(GridDeltaMessage::MAX_DELTA_BYTES >=
+                  GridDelta::HEADER_BYTES + GridDelta::MAX_CHUNK_BYTES,
+              "Grid delta messages must fit at least one chunk");
+
+GridReplicator::GridReplicator(Grid& grid, Server& server,
+                               ServerMessageTransmitter& messageTransmitter)
+    : grid(grid),
+      server(server),
+      messageTransmitter(messageTransmitter),
+      clients(server.getMaxConnections()) {}
+
+void GridReplicator::update(void) {
+    auto snapshot = grid.createSnapshot();
+
+    // The grid hands back the same snapshot until its tiles change
+    if (snapshot != lastSnapshot) {
+        std::vector<std::vector<uint8_t>> deltas;
+        if (lastSnapshot) {
+            deltas = GridDelta::encode(*snapshot, lastSnapshot.get(),
+                                       GridDeltaMessage::MAX_DELTA_BYTES);
+        }
+
+        for (auto& client : clients) {
+            if (client.isSynced) {
+                client.pendingDeltas.insert(client.pendingDeltas.end(), deltas.begin(),
+                                            deltas.end());
+            }
+        }
+
+        lastSnapshot = snapshot;
+    }
+
+    for (int clientIndex = 0; clientIndex < static_cast<int>(clients.size()); clientIndex++) {
+        auto& client = clients[clientIndex];
+
+        if (!server.isClientConnected(clientIndex)) {
+            client = ClientState();
+            continue;
+        }
+
+        if (!client.isSynced) {
+            auto deltas = GridDelta::encode(*snapshot, nullptr, GridDeltaMessage::MAX_DELTA_BYTES);
+            client.pendingDeltas.assign(deltas.begin(), deltas.end());
+            client.isSynced = true;
+
+            spdlog::debug("Sending {}x{} grid to client {} in {} messages", snapshot->getWidth(),
+                          snapshot->getHeight(), clientIndex, deltas.size());
+        }
+
+        while (!client.pendingDeltas.empty() &&
+               server.canSendMessage(clientIndex, MessageChannel::RELIABLE)) {
+            messageTransmitter.sendMessage(clientIndex, MessageType::GRID_DELTA,
+                                           client.pendingDeltas.front());
+            client.pendingDeltas.pop_front();
+        }
+    }
+}
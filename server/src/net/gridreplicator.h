@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "grid.h"
+#include "gridsnapshot.h"
+#include "server.h"
+#include "servermessagetransmitter.h"
+
+namespace SpaceRogueLite {
+
+/**
+ * @brief Keeps each connected client's copy of the grid in step with the server's.
+ *
+ * Clients are sent the whole grid when they connect, then deltas of the tiles changed between
+ * snapshots. Deltas queue per client and go out over the reliable channel as it has room, so a
+ * large sync doesn't overflow the channel's send queue.
+ */
+class GridReplicator {
+public:
+    GridReplicator(Grid& grid, Server& server, ServerMessageTransmitter& messageTransmitter);
+
+    void update(void);
+
+private:
+    struct ClientState {
+        bool isSynced = false;
+        std::deque<std::vector<uint8_t>> pendingDeltas;
+    };
+
+    Grid& grid;
+    Server& server;
+    ServerMessageTransmitter& messageTransmitter;
+
+    std::shared_ptr<const GridSnapshot> lastSnapshot;
+    std::vector<ClientState> clients;  // Indexed by client index
+};
+
+}  // namespace SpaceRogueLite
@@ -48,6 +48,14 @@ void Server::sendMessage(int clientIndex, Message* message) {
     server.SendMessage(clientIndex, static_cast<int>(message->getMessageChannel()), message);
 }
 
+bool Server::canSendMessage(int clientIndex, MessageChannel channel) {
+    return server.CanSendMessage(clientIndex, static_cast<int>(channel));
+}
+
+bool Server::isClientConnected(int clientIndex) { return server.IsClientConnected(clientIndex); }
+
+int Server::getMaxConnections(void) const { return maxConnections; }
+
 void Server::update(int64_t timeSinceLastFrame) {
     server.AdvanceTime(server.GetTime() + ((double) timeSinceLastFrame) / 1000.0f);
     server.ReceivePackets();
@@ -57,8 +65,14 @@ void Server::update(int64_t timeSinceLastFrame) {
     // TODO: Send a ping every second or so: https://github.com/networkprotocol/yojimbo/issues/138 and
     // https://github.com/networkprotocol/yojimbo/issues/146 Packets are intended to be sent pretty regulary - we can
     // remove this when we're sending packets more regularly
-    if (server.HasMessagesToSend(0, (int) MessageChannel::RELIABLE) ||
-        server.HasMessagesToSend(0, (int) MessageChannel::UNRELIABLE)) {
+    bool hasMessagesToSend = false;
+    for (int i = 0; i < maxConnections && !hasMessagesToSend; i++) {
+        hasMessagesToSend = server.IsClientConnected(i) &&
+                            (server.HasMessagesToSend(i, (int) MessageChannel::RELIABLE) ||
+                             server.HasMessagesToSend(i, (int) MessageChannel::UNRELIABLE));
+    }
+
+    if (hasMessagesToSend) {
         server.SendPackets();
     }
 }
@@ -44,6 +44,10 @@ public:
 
     Message* createMessage(int clientIndex, const MessageType& messageType);
     void sendMessage(int clientIndex, Message* message);
+    bool canSendMessage(int clientIndex, MessageChannel channel);
+
+    bool isClientConnected(int clientIndex);
+    int getMaxConnections(void) const;
 
     void update(int64_t timeSinceLastFrame);
 
@@ -71,6 +71,11 @@ inline void ServerMessageHandler::handleMessage<SpawnActorMessage>(int clientInd
     dispatcher.trigger<ActorSpawnEvent>({std::string(message->actorName)});
 }
 
+template <>
+inline void ServerMessageHandler::handleMessage<GridDeltaMessage>(int clientIndex, GridDeltaMessage* message) {
+    spdlog::warn("Ignoring grid delta from client {}, the server owns the grid", clientIndex);
+}
+
 /**
  * Creates a type-safe handler function for a specific message type
  *